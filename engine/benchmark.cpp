@@ -18,12 +18,21 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
 #include <vector>
 
+#include "evaluate.h"
+#include "movegen.h"
+#include "pawns.h"
 #include "position.h"
+#include "thread.h"
 
 using namespace std;
 
@@ -43,6 +52,72 @@ const vector<string> Defaults = {
   "4skq3/55/55/55/37/55/55/55/55/4SKQ3 w - Ss - 0 1",
 };
 
+// Perft counts of the bench positions and of a few positions reached in play,
+// with en passant moves and princess promotions among the moves.
+const vector<string> PerftSuite = {
+  "rnbskqtbnr/pppppppppp/55/55/55/55/55/55/PPPPPPPPPP/RNBSKQTBNR w KQkq Ss - 0 1 ; 5 ; 64202774",
+  "5k4/55/55/55/55/55/55/55/p9/4K5 w - Ss - 0 1 ; 4 ; 3645",
+  "5q4/55/55/55/55/55/55/5k4/55/4K5 w - Ss - 0 1 ; 4 ; 11614",
+  "55/55/55/55/55/55/55/5sk4/55/4K5 w - Ss - 0 1 ; 4 ; 1299",
+  "55/55/55/55/55/55/55/5tk4/55/4K5 w - Ss - 0 1 ; 4 ; 1299",
+  "rnbsk1111r/pppppqtppp/11111ppn11/1111b11111/1111111111/1111111111/1111111111/PPPPPPP111/1111111PPP/RNBSKQTBNR b KQkq Ss - 0 7 ; 4 ; 6962537",
+  "11kr1qtbnr/pppspppppp/11np111111/11111b1111/1111111111/1111111111/1111111111/PPPPP11111/11111PPPPP/RNBSKQTBNR w KQ Ss - 1 6 ; 4 ; 3450007",
+  "qqqk6/55/55/55/55/55/55/55/55/5KT3 b - Ss - 0 1 ; 4 ; 570986",
+  "rnbskqtbnr/1111111111/11S1111111/1111111111/1111111111/1111111111/1111111111/1111111111/PPPPPPPPPP/RNB1KQTBNR w KQkq Ss - 0 1 ; 4 ; 10003",
+  "k8q/55/55/55/PPP7/55/55/55/55/KQ8 w - Ss - 0 1 ; 4 ; 33789",
+  "4skq3/55/55/55/37/55/55/55/55/4SKQ3 w - Ss - 0 1 ; 4 ; 907660",
+  "4skq3/55/55/55/37/55/55/55/55/4SKQ3 w - Ss - 0 1 moves g1g10 ; 4 ; 93332",
+  "111rkBtbnr/1b1111p111/n1111111pp/111p1p1T11/pp11111111/11sp1111p1/P11P11P11P/1P1111111N/11NKPPQP11/1111111R1R w k S d9d7 0 31 ; 4 ; 9399085",
+  "11Bsk1qbnr/r11n1pp111/pp111111p1/1111p1111p/11pp111p11/1PP11P1PPP/111PN11111/P1N1K11111/1111P1P111/RSB1t1Q11R w k Ss - 0 22 ; 4 ; 527593",
+};
+
+// A MicroResult holds the time per call, in nanoseconds, of each sample of
+// one of the timed functions.
+struct MicroResult {
+  string name;
+  uint64_t calls;
+  vector<double> ns;
+};
+
+// time_calls() times a pass over the corpus, after a first one to warm up the
+// caches and hash tables. The pass returns the number of calls it made.
+template<typename Pass>
+MicroResult time_calls(const string& name, int samples, Pass pass) {
+
+  using namespace std::chrono;
+
+  MicroResult r { name, pass(), {} };
+
+  for (int i = 0; i < samples; ++i)
+  {
+      auto start = steady_clock::now();
+      r.calls = pass();
+      double ns = duration<double, std::nano>(steady_clock::now() - start).count();
+      r.ns.push_back(ns / std::max(r.calls, uint64_t(1)));
+  }
+
+  return r;
+}
+
+// generate_pass() calls generate<Type>() on each position of the corpus where
+// it applies: the evasions in check, the other types out of check and the
+// legal moves everywhere.
+template<GenType Type>
+uint64_t generate_pass(std::deque<Position>& corpus, uint64_t& sink) {
+
+  ExtMove moves[MAX_MOVES];
+  uint64_t calls = 0;
+
+  for (Position& pos : corpus)
+      if (Type == LEGAL || bool(pos.checkers()) == (Type == EVASIONS))
+      {
+          sink += generate<Type>(pos, moves) - moves;
+          ++calls;
+      }
+
+  return calls;
+}
+
 } // namespace
 
 /// setup_bench() builds a list of UCI commands to be run by bench. There
@@ -110,3 +185,216 @@ vector<string> setup_bench(const Position& current, istream& is) {
 
   return list;
 }
+
+
+/// setup_perft_suite() returns the entries of a perft suite, one per line in
+/// the form "<fen> [moves ...] ; <depth> ; <nodes>". The moves, if any, lead to
+/// the position to count from, and the expected node count may be left out to
+/// have it printed. The parameter is a file name, or "default" for the built-in
+/// suite. Empty lines and lines starting with '#' are skipped.
+///
+/// perftsuite -> check the built-in suite
+/// perftsuite movegen.suite -> check the entries of file movegen.suite
+
+vector<string> setup_perft_suite(istream& is) {
+
+  vector<string> list;
+  string token;
+
+  string suiteFile = (is >> token) ? token : "default";
+
+  if (suiteFile == "default")
+      return PerftSuite;
+
+  string line;
+  ifstream file(suiteFile);
+
+  if (!file.is_open())
+  {
+      cerr << "Unable to open file " << suiteFile << endl;
+      return list;
+  }
+
+  while (getline(file, line))
+      if (!line.empty() && line[0] != '#')
+          list.push_back(line);
+
+  file.close();
+
+  return list;
+}
+
+
+/// microbench() times the move generation, move making and evaluation functions
+/// one by one, over a corpus made of the given positions and of every position
+/// one legal move away from them. Each function is timed in several samples,
+/// and the results are printed as JSON with the time per call in nanoseconds:
+/// the mean over the samples, its variance and standard deviation, and the best.
+///
+/// microbench -> time on the bench positions, 10 samples
+/// microbench positions.fen 20 -> time on the positions of a file, 20 samples
+
+void microbench(istream& is) {
+
+  vector<string> fens;
+  string token;
+
+  string fenFile = (is >> token) ? token : "default";
+  int samples    = (is >> token) ? std::max(stoi(token), 2) : 10;
+
+  if (fenFile == "default")
+      fens = Defaults;
+  else
+  {
+      string fen;
+      ifstream file(fenFile);
+
+      if (!file.is_open())
+      {
+          cerr << "Unable to open file " << fenFile << endl;
+          return;
+      }
+
+      while (getline(file, fen))
+          if (!fen.empty())
+              fens.push_back(fen);
+  }
+
+  // Extend the corpus with the children of the given positions
+  size_t roots = fens.size();
+  for (size_t i = 0; i < roots; ++i)
+  {
+      StateInfo st, st2;
+      Position pos;
+      pos.set(fens[i], &st, Threads.main());
+
+      for (const auto& m : MoveList<LEGAL>(pos))
+      {
+          pos.do_move(m, st2);
+          fens.push_back(pos.fen());
+          pos.undo_move(m);
+      }
+  }
+
+  sort(fens.begin(), fens.end());
+  fens.erase(unique(fens.begin(), fens.end()), fens.end());
+
+  std::deque<Position> corpus(fens.size());
+  std::deque<StateInfo> states(fens.size());
+  vector<vector<Move>> legalMoves, pseudoMoves;
+
+  for (size_t i = 0; i < fens.size(); ++i)
+  {
+      Position& pos = corpus[i];
+      pos.set(fens[i], &states[i], Threads.main());
+
+      legalMoves.emplace_back();
+      for (const auto& m : MoveList<LEGAL>(pos))
+          legalMoves.back().push_back(m);
+
+      pseudoMoves.emplace_back();
+      if (pos.checkers())
+          for (const auto& m : MoveList<EVASIONS>(pos))
+              pseudoMoves.back().push_back(m);
+      else
+          for (const auto& m : MoveList<NON_EVASIONS>(pos))
+              pseudoMoves.back().push_back(m);
+  }
+
+  uint64_t sink = 0;
+  vector<MicroResult> results;
+
+  results.push_back(time_calls("generate<CAPTURES>",     samples, [&]() { return generate_pass<CAPTURES>(corpus, sink); }));
+  results.push_back(time_calls("generate<QUIETS>",       samples, [&]() { return generate_pass<QUIETS>(corpus, sink); }));
+  results.push_back(time_calls("generate<QUIET_CHECKS>", samples, [&]() { return generate_pass<QUIET_CHECKS>(corpus, sink); }));
+  results.push_back(time_calls("generate<EVASIONS>",     samples, [&]() { return generate_pass<EVASIONS>(corpus, sink); }));
+  results.push_back(time_calls("generate<NON_EVASIONS>", samples, [&]() { return generate_pass<NON_EVASIONS>(corpus, sink); }));
+  results.push_back(time_calls("generate<LEGAL>",        samples, [&]() { return generate_pass<LEGAL>(corpus, sink); }));
+
+  results.push_back(time_calls("do_move+undo_move", samples, [&]() {
+      uint64_t calls = 0;
+      StateInfo st;
+      for (size_t i = 0; i < corpus.size(); ++i)
+          for (Move m : legalMoves[i])
+          {
+              corpus[i].do_move(m, st);
+              corpus[i].undo_move(m);
+              ++calls;
+          }
+      return calls;
+  }));
+
+  results.push_back(time_calls("legal", samples, [&]() {
+      uint64_t calls = 0;
+      for (size_t i = 0; i < corpus.size(); ++i)
+          for (Move m : pseudoMoves[i])
+              sink += corpus[i].legal(m), ++calls;
+      return calls;
+  }));
+
+  results.push_back(time_calls("gives_check", samples, [&]() {
+      uint64_t calls = 0;
+      for (size_t i = 0; i < corpus.size(); ++i)
+          for (Move m : legalMoves[i])
+              sink += corpus[i].gives_check(m), ++calls;
+      return calls;
+  }));
+
+  results.push_back(time_calls("see_ge", samples, [&]() {
+      uint64_t calls = 0;
+      for (size_t i = 0; i < corpus.size(); ++i)
+          for (Move m : legalMoves[i])
+              sink += corpus[i].see_ge(m), ++calls;
+      return calls;
+  }));
+
+  results.push_back(time_calls("attackers_to", samples, [&]() {
+      uint64_t calls = 0;
+      for (Position& pos : corpus)
+          for (Bitboard b = AllSquares; b; ++calls)
+              sink += bool(pos.attackers_to(pop_lsb(&b)));
+      return calls;
+  }));
+
+  results.push_back(time_calls("Eval::evaluate", samples, [&]() {
+      uint64_t calls = 0;
+      for (Position& pos : corpus)
+          if (!pos.checkers())
+              sink += Eval::evaluate(pos), ++calls;
+      return calls;
+  }));
+
+  results.push_back(time_calls("Pawns::probe", samples, [&]() {
+      uint64_t calls = 0;
+      for (Position& pos : corpus)
+          sink += bool(Pawns::probe(pos)), ++calls;
+      return calls;
+  }));
+
+  cout << fixed << setprecision(2)
+       << "{\n  \"positions\": " << corpus.size()
+       << ",\n  \"samples\": " << samples
+       << ",\n  \"results\": [";
+
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+      const MicroResult& r = results[i];
+      double mean = 0, var = 0;
+
+      for (double ns : r.ns)
+          mean += ns / r.ns.size();
+
+      for (double ns : r.ns)
+          var += (ns - mean) * (ns - mean) / (r.ns.size() - 1);
+
+      cout << (i ? "," : "") << "\n    { \"name\": \"" << r.name << "\""
+           << ", \"calls\": " << r.calls
+           << ", \"ns_per_op\": " << mean
+           << ", \"variance\": " << var
+           << ", \"stddev\": " << std::sqrt(var)
+           << ", \"min\": " << *std::min_element(r.ns.begin(), r.ns.end()) << " }";
+  }
+
+  cout << "\n  ],\n  \"checksum\": " << sink << "\n}" << endl;
+  cout.unsetf(ios::fixed);
+}
@@ -29,6 +29,7 @@ uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
 Bitboard LineBB[SQUARE_NB][SQUARE_NB];
 Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
+RoyalJump RoyalJumps[SQUARE_NB][8];
 
 
 /// Bitboards::pretty() returns an ASCII representation of a bitboard suitable
@@ -58,10 +59,14 @@ void Bitboards::init() {
 
   for (Square s1 = SQ_A1; s1 <= SQ_J10; ++s1)
       for (Square s2 = SQ_A1; s2 <= SQ_J10; ++s2)
-          SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
+          if (is_ok(s1) && is_ok(s2))
+              SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
 
   for (Square s1 = SQ_A1; s1 <= SQ_J10; ++s1)
   {
+      if (!is_ok(s1))
+          continue; // Guard file of the padded layout
+
       for (int step : {NORTH, NORTH_EAST, EAST, SOUTH_EAST, SOUTH, SOUTH_WEST, WEST, NORTH_WEST} )
          PseudoAttacks[KING][s1] |= safe_destination(s1, step);
 
@@ -87,9 +92,21 @@ void Bitboards::init() {
           PseudoAttacks[PRINCE][s1] |= safe_destination(s1, step);
       }
 
+      RoyalJump* j = RoyalJumps[s1];
+
+      for (Direction d : {NORTH, EAST, SOUTH, WEST})
+      {
+          Direction side = (d == NORTH || d == SOUTH) ? EAST : NORTH;
+          *j++ = { safe_destination(s1, d) | safe_destination(s1, d + side) | safe_destination(s1, d - side),
+                   safe_destination(s1, d + d) };
+      }
+
+      for (Direction d : {NORTH_EAST, SOUTH_EAST, SOUTH_WEST, NORTH_WEST})
+          *j++ = { safe_destination(s1, d), safe_destination(s1, d + d) };
+
       for (PieceType pt : { BISHOP, ROOK })
           for (Square s2 = SQ_A1; s2 <= SQ_J10; ++s2)
-              if (PseudoAttacks[pt][s1] & s2)
+              if (is_ok(s2) && (PseudoAttacks[pt][s1] & s2))
               {
                   LineBB[s1][s2] = (attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0)) | s1 | s2;
               }
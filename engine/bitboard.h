@@ -34,14 +34,28 @@ const std::string pretty(Bitboard b);
 
 }
 
-constexpr Bitboard AllSquares = (~Bitboard(0)) >> 28;
-constexpr Bitboard DarkSquares = (Bitboard(0xAA955ULL))
-                               + (Bitboard(0xAA955ULL) << 20)
-                               + (Bitboard(0xAA955ULL) << 40)
-                               + (Bitboard(0xAA955ULL) << 60)
-                               + (Bitboard(0xAA955ULL) << 80);
-constexpr Bitboard FileABB = (Bitboard(0x10040100401ULL) << 50)
-                           +  Bitboard(0x10040100401ULL);
+constexpr Bitboard Rank1BB = 0x3FF;
+constexpr Bitboard Rank2BB = Rank1BB << (NORTH * 1);
+constexpr Bitboard Rank3BB = Rank1BB << (NORTH * 2);
+constexpr Bitboard Rank4BB = Rank1BB << (NORTH * 3);
+constexpr Bitboard Rank5BB = Rank1BB << (NORTH * 4);
+constexpr Bitboard Rank6BB = Rank1BB << (NORTH * 5);
+constexpr Bitboard Rank7BB = Rank1BB << (NORTH * 6);
+constexpr Bitboard Rank8BB = Rank1BB << (NORTH * 7);
+constexpr Bitboard Rank9BB = Rank1BB << (NORTH * 8);
+constexpr Bitboard Rank10BB= Rank1BB << (NORTH * 9);
+
+constexpr Bitboard AllSquares = Rank1BB | Rank2BB | Rank3BB | Rank4BB | Rank5BB
+                              | Rank6BB | Rank7BB | Rank8BB | Rank9BB | Rank10BB;
+
+// every_rank() repeats a first rank bit pattern on all the ranks of the board
+constexpr Bitboard every_rank(Bitboard pattern, int r = RANK_10) {
+  return r < RANK_1 ? 0 : (pattern << (NORTH * r)) | every_rank(pattern, r - 1);
+}
+
+constexpr Bitboard DarkSquares = (every_rank(0x155) & (Rank1BB | Rank3BB | Rank5BB | Rank7BB | Rank9BB))
+                               | (every_rank(0x2AA) & (Rank2BB | Rank4BB | Rank6BB | Rank8BB | Rank10BB));
+constexpr Bitboard FileABB = every_rank(1);
 constexpr Bitboard FileBBB = FileABB << 1;
 constexpr Bitboard FileCBB = FileABB << 2;
 constexpr Bitboard FileDBB = FileABB << 3;
@@ -52,17 +66,6 @@ constexpr Bitboard FileHBB = FileABB << 7;
 constexpr Bitboard FileIBB = FileABB << 8;
 constexpr Bitboard FileJBB = FileABB << 9;
 
-constexpr Bitboard Rank1BB = 0x3FF;
-constexpr Bitboard Rank2BB = Rank1BB << (10* 1);
-constexpr Bitboard Rank3BB = Rank1BB << (10* 2);
-constexpr Bitboard Rank4BB = Rank1BB << (10* 3);
-constexpr Bitboard Rank5BB = Rank1BB << (10* 4);
-constexpr Bitboard Rank6BB = Rank1BB << (10* 5);
-constexpr Bitboard Rank7BB = Rank1BB << (10* 6);
-constexpr Bitboard Rank8BB = Rank1BB << (10* 7);
-constexpr Bitboard Rank9BB = Rank1BB << (10* 8);
-constexpr Bitboard Rank10BB= Rank1BB << (10* 9);
-
 constexpr Bitboard QueenSide   = FileABB | FileBBB | FileCBB | FileDBB;
 constexpr Bitboard CenterFiles = FileDBB | FileEBB | FileFBB | FileGBB;
 constexpr Bitboard KingSide    = FileGBB | FileHBB | FileIBB | FileJBB;
@@ -80,6 +83,19 @@ extern uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
 extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 
+
+/// RoyalJump describes a two-square jump of a prince or princess: the jump to
+/// 'to' is possible as long as at least one of the 'gate' squares is empty. An
+/// orthogonal jump passes by any of the three squares in front of the piece, a
+/// diagonal one only by the corner square.
+
+struct RoyalJump {
+  Bitboard gate;
+  Bitboard to;
+};
+
+extern RoyalJump RoyalJumps[SQUARE_NB][8];
+
 inline Bitboard square_bb(Square s) {
   assert(is_ok(s));
   return Bitboard(1) << s;
@@ -106,7 +122,7 @@ constexpr bool more_than_one(Bitboard b) {
 }
 
 constexpr bool opposite_colors(Square s1, Square s2) {
-  return (s1 + rank_of(s1) + s2 + rank_of(s2)) & 1;
+  return (file_of(s1) + rank_of(s1) + file_of(s2) + rank_of(s2)) & 1;
 }
 
 
@@ -114,7 +130,7 @@ constexpr bool opposite_colors(Square s1, Square s2) {
 /// the given file or rank.
 
 inline Bitboard rank_bb(Rank r) {
-  return Rank1BB << (10 * r);
+  return Rank1BB << (NORTH * r);
 }
 
 inline Bitboard rank_bb(Square s) {
@@ -130,25 +146,31 @@ inline Bitboard file_bb(Square s) {
 }
 
 
-/// shift() moves a bitboard one or two steps as specified by the direction D
+/// shift() moves a bitboard one or two steps as specified by the direction D.
+/// With the padded layout a single step off the east or west edge lands on the
+/// guard file, which AllSquares masks out, so only double steps need a file mask.
 
 template<Direction D>
 constexpr Bitboard shift(Bitboard b) {
-  return AllSquares & 
-        ( D == NORTH       ?  b                        <<10
-        : D == SOUTH       ?  b                        >> 10
-        : D == NORTH+NORTH ?  b                        <<20
-        : D == NORTH+NORTH+NORTH ?  b                  <<30
-        : D == SOUTH+SOUTH ?  b                        >>20
-        : D == SOUTH+SOUTH+SOUTH ?  b                  >>30
-        : D == EAST+EAST   ? (b & ~FileJBB & ~FileIBB) << 2
-        : D == WEST+WEST   ? (b & ~FileABB & ~FileBBB) >> 2
-        : D == EAST        ? (b & ~FileJBB)            << 1
-        : D == WEST        ? (b & ~FileABB)            >> 1
-        : D == NORTH_EAST  ? (b & ~FileJBB)            <<11
-        : D == NORTH_WEST  ? (b & ~FileABB)            << 9
-        : D == SOUTH_EAST  ? (b & ~FileJBB)            >> 9
-        : D == SOUTH_WEST  ? (b & ~FileABB)            >>11
+  constexpr Bitboard NotA = IsPadded ? AllSquares : ~FileABB;
+  constexpr Bitboard NotJ = IsPadded ? AllSquares : ~FileJBB;
+  constexpr Bitboard NotB = IsPadded ? AllSquares : ~FileBBB;
+  constexpr Bitboard NotI = IsPadded ? AllSquares : ~FileIBB;
+  return AllSquares &
+        ( D == NORTH       ?  b                        << NORTH
+        : D == SOUTH       ?  b                        >> NORTH
+        : D == NORTH+NORTH ?  b                        << (2 * NORTH)
+        : D == NORTH+NORTH+NORTH ?  b                  << (3 * NORTH)
+        : D == SOUTH+SOUTH ?  b                        >> (2 * NORTH)
+        : D == SOUTH+SOUTH+SOUTH ?  b                  >> (3 * NORTH)
+        : D == EAST+EAST   ? (b & ~FileJBB & NotI)     << 2
+        : D == WEST+WEST   ? (b & ~FileABB & NotB)     >> 2
+        : D == EAST        ? (b & NotJ)                << 1
+        : D == WEST        ? (b & NotA)                >> 1
+        : D == NORTH_EAST  ? (b & NotJ)                << NORTH_EAST
+        : D == NORTH_WEST  ? (b & NotA)                << NORTH_WEST
+        : D == SOUTH_EAST  ? (b & NotJ)                >> NORTH_WEST
+        : D == SOUTH_WEST  ? (b & NotA)                >> NORTH_EAST
         : 0);
 }
 
@@ -213,7 +235,7 @@ inline Bitboard line_bb(Square s1, Square s2) {
 /// between_bb(SQ_C4, SQ_F7) will return a bitboard with squares D5 and E6.
 
 inline Bitboard between_bb(Square s1, Square s2) {
-  Bitboard b = line_bb(s1, s2) & ((AllSquares << s1) ^ (AllSquares << s2));
+  Bitboard b = line_bb(s1, s2) & ((~Bitboard(0) << s1) ^ (~Bitboard(0) << s2));
   return b & (b - 1); //exclude lsb
 }
 
@@ -223,8 +245,8 @@ inline Bitboard between_bb(Square s1, Square s2) {
 /// forward_ranks_bb(BLACK, SQ_D3) will return the 16 squares on ranks 1 and 2.
 
 inline Bitboard forward_ranks_bb(Color c, Square s) {
-  return c == WHITE ? ~Rank1BB << 10 * relative_rank(WHITE, s)
-                    : (AllSquares & ~Rank10BB) >> 10 * relative_rank(BLACK, s);
+  return c == WHITE ? AllSquares & (~Rank1BB << NORTH * relative_rank(WHITE, s))
+                    : (AllSquares & ~Rank10BB) >> NORTH * relative_rank(BLACK, s);
 }
 
 
@@ -282,45 +304,17 @@ inline Bitboard safe_destination(Square s, int step)
     return is_ok(to) && distance(s, to) <= 2 ? square_bb(to) : Bitboard(0);
 }
 
+/// royal_attacks() returns the squares attacked by a prince or princess: the
+/// king steps plus the two-square jumps that are not walled off.
+
 inline Bitboard royal_attacks(Square sq, Bitboard occupied)
 {
     Bitboard attacks = PseudoAttacks[KING][sq];
-    Bitboard sbb = square_bb(sq);
 
-    if (shift<NORTH>(sbb) & ~occupied) attacks |= shift<NORTH+NORTH>(sbb);
-    if (shift<EAST>(sbb) & ~occupied) attacks |= shift<EAST+EAST>(sbb);
-    if (shift<SOUTH>(sbb) & ~occupied) attacks |= shift<SOUTH+SOUTH>(sbb);
-    if (shift<WEST>(sbb) & ~occupied) attacks |= shift<WEST+WEST>(sbb);
-
-    if (shift<NORTH_WEST>(sbb) & ~occupied)
-    {
-        attacks |= shift<NORTH_WEST>(shift<NORTH_WEST>(sbb));
-        attacks |= shift<NORTH+NORTH>(sbb);
-        attacks |= shift<WEST + WEST>(sbb);
-    }
-    if (shift<NORTH_EAST>(sbb) & ~occupied)
-    {
-        attacks |= shift<NORTH_EAST>(shift<NORTH_EAST>(sbb));
-        attacks |= shift<NORTH+NORTH>(sbb);
-        attacks |= shift<EAST + EAST>(sbb);
-    }
-    if (shift<SOUTH_EAST>(sbb) & ~occupied)
-    {
-        attacks |= shift<SOUTH_EAST>(shift<SOUTH_EAST>(sbb));
-        attacks |= shift<SOUTH+SOUTH>(sbb);
-        attacks |= shift<EAST + EAST>(sbb);
-    }
-    if (shift<SOUTH_WEST>(sbb) & ~occupied)
-    {
-        attacks |= shift<SOUTH_WEST>(shift<SOUTH_WEST>(sbb));
-        attacks |= shift<SOUTH+SOUTH>(sbb);
-        attacks |= shift<WEST + WEST>(sbb);
-    }
+    for (const RoyalJump& j : RoyalJumps[sq])
+        if (j.gate & ~occupied)
+            attacks |= j.to;
 
-    //std::cout << "<prince moves: " << Bitboards::pretty(ourPieces)
-                                   //<< Bitboards::pretty(theirPieces)
-                                   //<< "<" << sq << ">"
-                                   //<< Bitboards::pretty(attacks);
     return attacks;
 }
 
@@ -432,10 +426,12 @@ inline Bitboard royal_wall(Square s1, Square s2) {
     return 0;
 }
 
-/// popcount() counts the number of non-zero bits in a bitboard
+/// popcount() counts the number of non-zero bits in a bitboard. std::bitset
+/// cannot be built from a 128-bit integer, so count both halves separately.
 inline int popcount(Bitboard b) {
 
-  return (std::bitset<128>(b)).count();
+  return int(  std::bitset<64>(uint64_t(b)).count()
+             + std::bitset<64>(uint64_t(b >> 64)).count());
 }
 
 
@@ -454,15 +450,15 @@ inline Square lsb(Bitboard b) {
   return Square(square);
 }
 
-// Assumes at most the 100th bit is set.
+// Assumes no bit above SQ_J10 is set.
 inline Square msb(Bitboard b) {
   assert(b);
 
-  constexpr Bitboard bit100 = Bitboard(1) << 100;
+  constexpr Bitboard topBit = Bitboard(1) << SQ_J10;
   int square = SQ_J10;
   while(b)
   {
-      if (b & bit100) break;
+      if (b & topBit) break;
       b <<= 1;
       square--;
   }
@@ -48,8 +48,12 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <vector>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 #include "misc.h"
@@ -91,9 +95,35 @@ struct Tie: public streambuf { // MSVC requires split streambuf for cin and cout
   }
 };
 
+/// Tag prefixes each line written to std::cout with SyncTag, the tag of the
+/// writing thread, so that every line of a multi-line output is tagged too.
+/// It is installed before main(), and the logger ties its buffer to the log file
+/// so that the log gets the tags as well.
+
+struct Tag: public streambuf {
+
+  Tag() : buf(cout.rdbuf()) { cout.rdbuf(this); }
+ ~Tag() { cout.rdbuf(buf); }
+
+  int sync() override { return buf->pubsync(); }
+  int overflow(int c) override {
+
+    if (lineStart && !SyncTag.empty())
+        buf->sputn(SyncTag.data(), streamsize(SyncTag.size()));
+
+    lineStart = c == '\n';
+    return buf->sputc((char)c);
+  }
+
+  streambuf* buf;
+  bool lineStart = true;
+};
+
+Tag CoutTag;
+
 class Logger {
 
-  Logger() : in(cin.rdbuf(), file.rdbuf()), out(cout.rdbuf(), file.rdbuf()) {}
+  Logger() : in(cin.rdbuf(), file.rdbuf()), out(CoutTag.buf, file.rdbuf()) {}
  ~Logger() { start(""); }
 
   ofstream file;
@@ -115,11 +145,11 @@ public:
         }
 
         cin.rdbuf(&l.in);
-        cout.rdbuf(&l.out);
+        CoutTag.buf = &l.out;
     }
     else if (fname.empty() && l.file.is_open())
     {
-        cout.rdbuf(l.out.buf);
+        CoutTag.buf = l.out.buf;
         cin.rdbuf(l.in.buf);
         l.file.close();
     }
@@ -247,7 +277,10 @@ void dbg_print() {
 
 
 /// Used to serialize access to std::cout to avoid multiple threads writing at
-/// the same time.
+/// the same time. The lines start with the tag of the writing thread, if any,
+/// see Tag.
+
+thread_local std::string SyncTag;
 
 std::ostream& operator<<(std::ostream& os, SyncCout sc) {
 
@@ -294,9 +327,16 @@ void prefetch(void* addr) {
 #endif
 
 
+bool UseHugePages = true;
+
 /// aligned_ttmem_alloc() will return suitably aligned memory, and if possible use large pages.
 /// The returned pointer is the aligned one, while the mem argument is the one that needs
 /// to be passed to free. With c++17 some of this functionality could be simplified.
+/// aligned_large_pages_alloc() is its simpler form for the large tables of the threads,
+/// returning a pointer to pass to aligned_large_pages_free(), and using large pages only
+/// when UseHugePages is set.
+/// large_pages_discard() gives the whole pages inside a range back to the system
+/// on Linux, keeping the range allocated. They read as zeros when touched again.
 
 #if defined(__linux__) && !defined(__ANDROID__)
 
@@ -310,6 +350,30 @@ void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
   return mem;
 }
 
+void* aligned_large_pages_alloc(size_t allocSize) {
+
+  constexpr size_t alignment = 2 * 1024 * 1024; // assumed 2MB page sizes
+  size_t size = ((allocSize + alignment - 1) / alignment) * alignment; // multiple of alignment
+  void* mem;
+
+  if (posix_memalign(&mem, alignment, size))
+      return nullptr;
+
+  // Ask explicitly for small pages when disabled, as THP may be set to always
+  madvise(mem, size, UseHugePages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+  return mem;
+}
+
+void large_pages_discard(void* mem, size_t size) {
+
+  uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+  uintptr_t begin = (uintptr_t(mem) + pageSize - 1) & ~(pageSize - 1);
+  uintptr_t end = (uintptr_t(mem) + size) & ~(pageSize - 1);
+
+  if (begin < end)
+      madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+}
+
 #elif defined(_WIN64)
 
 static void* aligned_ttmem_alloc_large_pages(size_t allocSize) {
@@ -382,6 +446,18 @@ void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
   return mem;
 }
 
+void* aligned_large_pages_alloc(size_t allocSize) {
+
+  void* mem = UseHugePages ? aligned_ttmem_alloc_large_pages(allocSize) : nullptr;
+
+  if (!mem)
+      mem = VirtualAlloc(NULL, allocSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+  return mem;
+}
+
+void large_pages_discard(void*, size_t) {}
+
 #else
 
 void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
@@ -393,6 +469,12 @@ void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
   return ret;
 }
 
+void* aligned_large_pages_alloc(size_t allocSize) {
+  return malloc(allocSize);
+}
+
+void large_pages_discard(void*, size_t) {}
+
 #endif
 
 
@@ -411,23 +493,199 @@ void aligned_ttmem_free(void* mem) {
   }
 }
 
+void aligned_large_pages_free(void* mem) {
+  aligned_ttmem_free(mem);
+}
+
 #else
 
 void aligned_ttmem_free(void *mem) {
   free(mem);
 }
 
+void aligned_large_pages_free(void* mem) {
+  free(mem);
+}
+
 #endif
 
 
+/// large_pages_info() describes the use of transparent huge pages by the process,
+/// or returns an empty string when it is not known.
+
+std::string large_pages_info() {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+  std::ifstream modes("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string mode, line;
+
+  // The current mode is the one in brackets, as in "always [madvise] never"
+  while (modes >> mode && mode[0] != '[') {}
+
+  if (mode.size() < 3 || mode[0] != '[')
+      return "";
+
+  std::stringstream ss;
+  ss << "Huge pages: " << (UseHugePages ? "on" : "off")
+     << ", transparent huge pages " << mode.substr(1, mode.size() - 2);
+
+  while (getline(smaps, line))
+      if (line.find("AnonHugePages:") == 0)
+          ss << ", " << std::stoll(line.substr(14)) / 1024 << " MB in use";
+
+  return ss.str();
+
+#else
+
+  return "";
+
+#endif
+}
+
+
 namespace WinProcGroup {
 
-#ifndef _WIN32
+#if defined(__linux__) && !defined(__ANDROID__) && !defined(ROYAL_WASM)
+
+/// read_cpu_list() parses a sysfs list of CPUs or nodes, like "0-7,16-23"
+
+std::vector<int> read_cpu_list(const std::string& path) {
+
+  std::vector<int> list;
+  std::ifstream file(path);
+  std::string range;
+
+  while (getline(file, range, ','))
+  {
+      int first, last;
+      int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+
+      if (n < 1)
+          continue;
+
+      for (int c = first; c <= (n == 2 ? last : first); ++c)
+          list.push_back(c);
+  }
+
+  return list;
+}
+
+
+/// numa_nodes() reads the NUMA topology from sysfs and returns, for each
+/// online node, the CPUs of the node this process is allowed to run on.
+
+std::vector<std::vector<int>> numa_nodes() {
+
+  std::vector<std::vector<int>> nodes;
+  cpu_set_t allowed;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+      return nodes;
+
+  for (int n : read_cpu_list("/sys/devices/system/node/online"))
+  {
+      std::vector<int> cpus;
+
+      for (int c : read_cpu_list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"))
+          if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+              cpus.push_back(c);
+
+      if (!cpus.empty())
+          nodes.push_back(cpus);
+  }
+
+  return nodes;
+}
+
+
+/// best_node() returns the node for the thread with index idx, filling the
+/// physical cores of a node before moving on to the next one, as best_group()
+/// does under Windows, or -1 when there is no choice to make.
+
+int best_node(size_t idx, const std::vector<std::vector<int>>& nodes) {
+
+  if (nodes.size() < 2)
+      return -1;
+
+  std::vector<int> groups;
+  int threads = 0, cores = 0;
+
+  for (size_t n = 0; n < nodes.size(); ++n)
+      for (int c : nodes[n])
+      {
+          // A CPU stands for its core when it is the first of its siblings
+          std::vector<int> siblings = read_cpu_list("/sys/devices/system/cpu/cpu"
+                                      + std::to_string(c) + "/topology/thread_siblings_list");
+          if (siblings.empty() || siblings[0] == c)
+              groups.push_back(int(n)), cores++;
+
+          threads++;
+      }
+
+  // The other logical processors of the cores are spread evenly across nodes
+  for (int t = 0; t < threads - cores; t++)
+      groups.push_back(t % int(nodes.size()));
+
+  return idx < groups.size() ? groups[idx] : -1;
+}
+
+
+/// bindThisThread() sets the affinity of the current thread to the CPUs of
+/// its node. With the default memory policy of Linux, the pages the thread
+/// touches first are then allocated on that node.
+
+void bindThisThread(size_t idx) {
+
+  // Use only local variables to be thread-safe
+  std::vector<std::vector<int>> nodes = numa_nodes();
+  int node = best_node(idx, nodes);
+
+  if (node == -1)
+      return;
+
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+
+  for (int c : nodes[node])
+      CPU_SET(c, &mask);
+
+  pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+
+/// topology() describes the NUMA nodes found, or returns an empty string when
+/// there is only one.
+
+std::string topology() {
+
+  std::vector<std::vector<int>> nodes = numa_nodes();
+  std::stringstream ss;
+
+  if (nodes.size() < 2)
+      return "";
+
+  ss << nodes.size() << " NUMA nodes with";
+
+  for (size_t n = 0; n < nodes.size(); ++n)
+      ss << (n ? ", " : " ") << nodes[n].size();
+
+  ss << " CPUs";
+
+  return ss.str();
+}
+
+#elif !defined(_WIN32)
 
 void bindThisThread(size_t) {}
 
+std::string topology() { return ""; }
+
 #else
 
+std::string topology() { return ""; }
+
 /// best_group() retrieves logical processor information using Windows specific
 /// API and returns the best group id for the thread with index idx. Original
 /// code from Texel by Peter Österlund.
@@ -23,6 +23,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstdlib>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -35,6 +36,12 @@ void prefetch(void* addr);
 void start_logger(const std::string& fname);
 void* aligned_ttmem_alloc(size_t size, void*& mem);
 void aligned_ttmem_free(void* mem); // nop if mem == nullptr
+void* aligned_large_pages_alloc(size_t size);
+void aligned_large_pages_free(void* mem); // nop if mem == nullptr
+void large_pages_discard(void* mem, size_t size); // nop outside Linux
+std::string large_pages_info();
+
+extern bool UseHugePages;
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -50,18 +57,52 @@ inline TimePoint now() {
         (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
+inline int64_t now_micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// LargePageAllocator lets a std::vector keep its elements on large pages
+
+template<class T>
+struct LargePageAllocator {
+  typedef T value_type;
+
+  LargePageAllocator() = default;
+  template<class U> LargePageAllocator(const LargePageAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    void* mem = aligned_large_pages_alloc(n * sizeof(T));
+    if (!mem)
+        std::abort();
+    return static_cast<T*>(mem);
+  }
+  void deallocate(T* p, size_t) { aligned_large_pages_free(p); }
+
+  template<class U> bool operator==(const LargePageAllocator<U>&) const { return true; }
+  template<class U> bool operator!=(const LargePageAllocator<U>&) const { return false; }
+};
+
+/// HashTable is allocated on first use with allocate(), so that the owner may do
+/// it lazily and from the thread that uses it. release() gives its pages back to
+/// the system while unused, leaving the entries as zeroed as after allocate().
+
 template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+  void allocate() { if (table.empty()) table.resize(Size); }
+  void release() { large_pages_discard(table.data(), table.size() * sizeof(Entry)); }
 
 private:
-  std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
+  std::vector<Entry, LargePageAllocator<Entry>> table;
 };
 
 
 enum SyncCout { IO_LOCK, IO_UNLOCK };
 std::ostream& operator<<(std::ostream&, SyncCout);
 
+extern thread_local std::string SyncTag; // Starts the cout lines of this thread
+
 #define sync_cout std::cout << IO_LOCK
 #define sync_endl std::endl << IO_UNLOCK
 
@@ -128,10 +169,12 @@ inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
 /// logical processor group. This usually means to be limited to use max 64
 /// cores. To overcome this, some special platform specific API should be
 /// called to set group affinity for each thread. Original code from Texel by
-/// Peter Österlund.
+/// Peter Österlund. Under Linux the threads are bound to the NUMA nodes read
+/// from sysfs instead.
 
 namespace WinProcGroup {
   void bindThisThread(size_t idx);
+  std::string topology();
 }
 
 #endif // #ifndef MISC_H_INCLUDED
@@ -211,7 +211,7 @@ namespace {
   template<Color Us, PieceType Pt, bool Checks>
   ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
 
-    static_assert(Pt != KING && Pt != PAWN, "Unsupported piece type in generate_moves()");
+    static_assert(Pt != KING && Pt != PAWN && Pt != PRINCESS && Pt != PRINCE, "Unsupported piece type in generate_moves()");
 
     Bitboard squares = pos.pieces(Us, Pt);
 
@@ -249,7 +249,41 @@ namespace {
   }
 
 
-  template<Color Us, GenType Type>
+  // generate_royal_moves() is the generate_moves() path for the prince and the
+  // princess. A side never has more than one of each, so there is no square
+  // loop, and the attacks come straight from the royal jump tables.
+  template<Color Us, PieceType Pt, bool Checks>
+  ExtMove* generate_royal_moves(const Position& pos, ExtMove* moveList, Bitboard target) {
+
+    static_assert(Pt == PRINCESS || Pt == PRINCE, "Unsupported piece type in generate_royal_moves()");
+
+    if (!pos.pieces(Us, Pt))
+        return moveList;
+
+    assert(!more_than_one(pos.pieces(Us, Pt)));
+
+    Square from = pos.square<Pt>(Us);
+
+    // Don't add moves from this piece if it is pinned
+    if (Checks && (pos.blockers_for_king(~Us) & from))
+        return moveList;
+
+    Bitboard b = royal_attacks(from, pos.pieces()) & target;
+
+    if (Checks)
+        b &= royal_attacks(pos.square<KING>(~Us), pos.pieces());
+
+    while (b)
+        *moveList++ = make_move(from, pop_lsb(&b));
+
+    return moveList;
+  }
+
+
+  // generate_all() only duplicates the moves with a princess promotion when
+  // Variants is set, which generate<LEGAL> does. The MovePicker asks for the
+  // plain lists and adds the promotion of each move itself when it is picked.
+  template<Color Us, GenType Type, bool Variants>
   ExtMove* generate_all(const Position& pos, ExtMove* moveList) {
     constexpr bool Checks = Type == QUIET_CHECKS; // Reduce template instantations
     Bitboard target;
@@ -270,37 +304,7 @@ namespace {
         case EVASIONS:
         {
             //std::cout << "<EVASIONS>";
-            Square checksq = lsb(pos.checkers());
-            Square ksq = pos.square<KING>(Us);
-            //target = between_bb(pos.square<KING>(Us), checksq) | checksq;
-            target = square_bb(checksq);
-
-            //if (pos.pieces(KNIGHT) & checksq)
-                //target = square_bb(checksq);
-            if (pos.pieces(BISHOP, ROOK) & checksq)
-                target |= between_bb(ksq, checksq);
-            else if (pos.pieces(QUEEN) & checksq)
-                target |= between_bb(ksq, checksq);
-            else if (pos.pieces(PRINCE, PRINCESS) & checksq)
-            {
-                if (attacks_bb<BISHOP>(checksq) & ksq) //corner attack
-                    target |= between_bb(ksq, checksq) | checksq;
-
-                else if(distance(checksq, ksq) == 2) //
-                {
-                    Bitboard wall = royal_wall(checksq, ksq);
-                    Bitboard openblocks = wall & ~pos.pieces();
-
-                    // If all are blocked, there shouldn't even be a check
-                    assert(openblocks);
-
-                    // If more than one block is missing, can't help
-                    if (!more_than_one(wall & ~pos.pieces()))
-                    {
-                        target |= openblocks;
-                    }
-                }
-            }
+            target = pos.evasion_target();
 
             //std::cout << "<OUTPUT TARGETS in EVASIONS: " << checksq << ">" << pos
                       //<< Bitboards::pretty(target);
@@ -323,8 +327,8 @@ namespace {
     moveList = generate_moves<Us, KNIGHT, Checks>(pos, moveList, target);
     moveList = generate_moves<Us, BISHOP, Checks>(pos, moveList, target);
     moveList = generate_moves<Us,   ROOK, Checks>(pos, moveList, target);
-    moveList = generate_moves<Us, PRINCESS, Checks>(pos, moveList, target);
-    moveList = generate_moves<Us, PRINCE, Checks>(pos, moveList, target);
+    moveList = generate_royal_moves<Us, PRINCESS, Checks>(pos, moveList, target);
+    moveList = generate_royal_moves<Us,   PRINCE, Checks>(pos, moveList, target);
     moveList = generate_moves<Us,  QUEEN, Checks>(pos, moveList, target);
 
     if (Type != QUIET_CHECKS && Type != EVASIONS)
@@ -347,9 +351,7 @@ namespace {
     ExtMove * endMoves = moveList;
 
     // Check if the enemy king was attacked. . If so, remove all non-king att
-    bool kingAttacked = pos.attackers_to(pos.square<KING>(~Us), pos.pieces()) & pos.pieces(Us);
-
-    if (kingAttacked) //remove all non-king attack moves
+    if (pos.king_capturers()) //remove all non-king attack moves
     {
         //std::cout << "<king attacked: remove some moves.>" << std::endl;
         for(ExtMove* ml = startMoves; ml < moveList; ml++)
@@ -370,12 +372,13 @@ namespace {
         Square princessSquare = pos.square<PRINCESS>(Us);
         //duplicate all moves and add the queen promotion to them.
         //except the ones from the princess square
-        for(ExtMove* ml = startMoves; ml < endMoves; ml++)
-        {
-            Move m = ml->move;
-            if (from_sq(m) != princessSquare)
-                *moveList++ = Move(m | (1 << 20));
-        }
+        if (Variants)
+            for(ExtMove* ml = startMoves; ml < endMoves; ml++)
+            {
+                Move m = ml->move;
+                if (from_sq(m) != princessSquare)
+                    *moveList++ = Move(m | (1 << 20));
+            }
 
         //Now, add all moves than the new queen could do (with promotion)
         if (Checks)
@@ -429,8 +432,8 @@ ExtMove* generate(const Position& pos, ExtMove* moveList) {
 
   Color us = pos.side_to_move();
 
-  return us == WHITE ? generate_all<WHITE, Type>(pos, moveList)
-                     : generate_all<BLACK, Type>(pos, moveList);
+  return us == WHITE ? generate_all<WHITE, Type, false>(pos, moveList)
+                     : generate_all<BLACK, Type, false>(pos, moveList);
 }
 
 // Explicit template instantiations
@@ -463,15 +466,16 @@ ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
          *moveList++ = make_move(from, pop_lsb(&b));
   }
 
-  return us == WHITE ? generate_all<WHITE, QUIET_CHECKS>(pos, moveList)
-                     : generate_all<BLACK, QUIET_CHECKS>(pos, moveList);
+  return us == WHITE ? generate_all<WHITE, QUIET_CHECKS, false>(pos, moveList)
+                     : generate_all<BLACK, QUIET_CHECKS, false>(pos, moveList);
 }
 
 
-/// generate<EVASIONS> generates all pseudo-legal check evasions when the side
-/// to move is in check. Returns a pointer to the end of the move list.
-template<>
-ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
+/// generate_evasions() generates all pseudo-legal check evasions when the side
+/// to move is in check, with the princess promotion variants when Variants is
+/// set. Returns a pointer to the end of the move list.
+template<bool Variants>
+ExtMove* generate_evasions(const Position& pos, ExtMove* moveList) {
 
   assert(pos.checkers());
 
@@ -511,42 +515,85 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
   }
 
   // Generate blocking evasions or captures of the checking piece
-  return us == WHITE ? generate_all<WHITE, EVASIONS>(pos, moveList)
-                     : generate_all<BLACK, EVASIONS>(pos, moveList);
+  return us == WHITE ? generate_all<WHITE, EVASIONS, Variants>(pos, moveList)
+                     : generate_all<BLACK, EVASIONS, Variants>(pos, moveList);
+}
+
+template<>
+ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
+  return generate_evasions<false>(pos, moveList);
 }
 
 
-/// generate<LEGAL> generates all the legal moves in the given position
+/// generate<LEGAL> generates all the legal moves in the given position.
+/// The royal threats are resolved once per position, so that only the moves
+/// which can change them (king moves, moves off a line or ring around our king,
+/// moves that leave an attacker alive, checks while we have a prince, queen
+/// captures against a princess and special moves) go through Position::legal().
 
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
   Color us = pos.side_to_move();
+  Square ksq = pos.square<KING>(us);
   Square theirKing = pos.square<KING>(~us);
-  ExtMove *cur = moveList, *cur2 = moveList, *startMoves = moveList;
-  bool kingAttacked = pos.attackers_to(pos.square<KING>(~us), pos.pieces()) & pos.pieces(us);
-
-  moveList = pos.checkers() ? generate<EVASIONS    >(pos, moveList)
-                            : generate<NON_EVASIONS>(pos, moveList);
+  ExtMove *cur = moveList, *startMoves = moveList;
+  bool kingAttacked = pos.king_capturers();
+  bool hasPrince = pos.pieces(us, PRINCE);
+
+  // Without a prince our king must stay safe. Only a piece on the first square
+  // of a line from the king can uncover a slider or a royal when it moves away,
+  // and an attacker already there must be the captured piece.
+  Bitboard exposed   = hasPrince ? 0 : attacks_bb<QUEEN>(ksq, pos.pieces());
+  Bitboard attackers = hasPrince ? 0 : pos.king_attackers();
+  Bitboard pinned    = pos.blockers_for_king(us);
+  Bitboard queens    = pos.pieces(~us, PRINCESS) ? pos.pieces(~us, QUEEN) : 0;
+
+  // With a prince our king may stay attacked, but not by a move that attacks
+  // the enemy king, so keep the squares from where each piece type does that.
+  Bitboard checkSquares[PIECE_TYPE_NB] = {};
+  if (hasPrince)
+      for (PieceType pt : { KNIGHT, BISHOP, ROOK, PRINCESS, QUEEN, PRINCE, KING })
+          checkSquares[pt] = pos.check_squares(pt);
+
+  // Perft counts every princess promotion variant, so ask for them here
+  moveList = pos.checkers() ? generate_evasions<true>(pos, moveList)
+           : us == WHITE    ? generate_all<WHITE, NON_EVASIONS, true>(pos, moveList)
+                            : generate_all<BLACK, NON_EVASIONS, true>(pos, moveList);
   while (cur != moveList)
   {
-      if (!pos.legal(*cur))
+      Move m = *cur;
+      Square from = from_sq(m), to = to_sq(m);
+      bool legal;
+
+      // If a move attacks the enemy king (regardless of prince), other moves
+      // are not legal.
+      if (kingAttacked && to != theirKing)
+          legal = false;
+
+      else if (   type_of(m) == ENPASSANT
+               || type_of(m) == CASTLING
+               || promote_princess(m)
+               || from == ksq
+               || ((exposed | pinned) & from)
+               || (attackers & ~square_bb(to))
+               || (queens & to)
+               || ((  checkSquares[type_of(pos.piece_on(from))]
+                    | (type_of(m) == PROMOTION ? checkSquares[promotion_type(m)] : 0)) & to))
+          legal = pos.legal(m);
+
+      else
+      {
+          assert(pos.legal(m));
+          legal = true;
+      }
+
+      if (!legal)
           *cur = (--moveList)->move;
       else
           ++cur;
   }
 
-  // If a move attacks the enemy king (regardless of prince), other moves are
-  // not legal and are removed from the list.
-  if (kingAttacked)
-  {
-      while (cur2 != moveList)
-          if (to_sq(*cur2) != theirKing)
-              *cur2 = (--moveList)->move;
-          else
-              ++cur2;
-  }
-
   // if the princess can promote to a queen, add those moves
   if (pos.queen_captured() && pos.pieces(us, PRINCESS))
   {
@@ -39,6 +39,7 @@ enum GenType {
 struct ExtMove {
   Move move;
   int value;
+  Value see; // Exchange value of a capture, set by the MovePicker
 
   operator Move() const { return move; }
   void operator=(Move m) { move = m; }
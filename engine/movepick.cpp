@@ -47,6 +47,15 @@ namespace {
         }
   }
 
+  // promoting_princess() returns the square of the princess of the side to move
+  // if she may promote with this move, SQ_NONE otherwise.
+  Square promoting_princess(const Position& pos) {
+
+    Color us = pos.side_to_move();
+    return pos.queen_captured() && pos.pieces(us, PRINCESS) ? pos.square<PRINCESS>(us)
+                                                            : SQ_NONE;
+  }
+
 } // namespace
 
 
@@ -60,7 +69,9 @@ namespace {
 MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHistory* mh, const LowPlyHistory* lp,
                        const CapturePieceToHistory* cph, const PieceToHistory** ch, Move cm, const Move* killers, int pl)
            : pos(p), mainHistory(mh), lowPlyHistory(lp), captureHistory(cph), continuationHistory(ch),
-             ttMove(ttm), refutations{{killers[0], 0}, {killers[1], 0}, {cm, 0}}, depth(d), ply(pl) {
+             ttMove(ttm), variant(MOVE_NONE), lastMove(MOVE_NONE), moveSee(VALUE_NONE), variantSee(VALUE_NONE),
+             refutations{{killers[0], 0, VALUE_NONE}, {killers[1], 0, VALUE_NONE}, {cm, 0, VALUE_NONE}},
+             princessSquare(promoting_princess(p)), depth(d), ply(pl) {
 
   assert(d > 0);
 
@@ -71,7 +82,9 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
 /// MovePicker constructor for quiescence search
 MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHistory* mh,
                        const CapturePieceToHistory* cph, const PieceToHistory** ch, Square rs)
-           : pos(p), mainHistory(mh), captureHistory(cph), continuationHistory(ch), ttMove(ttm), recaptureSquare(rs), depth(d) {
+           : pos(p), mainHistory(mh), captureHistory(cph), continuationHistory(ch), ttMove(ttm), variant(MOVE_NONE),
+             lastMove(MOVE_NONE), moveSee(VALUE_NONE), variantSee(VALUE_NONE),
+             princessSquare(promoting_princess(p)), recaptureSquare(rs), depth(d) {
 
   assert(d <= 0);
 
@@ -83,7 +96,9 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
 /// MovePicker constructor for ProbCut: we generate captures with SEE greater
 /// than or equal to the given threshold.
 MovePicker::MovePicker(const Position& p, Move ttm, Value th, const CapturePieceToHistory* cph)
-           : pos(p), captureHistory(cph), ttMove(ttm), threshold(th) {
+           : pos(p), captureHistory(cph), ttMove(ttm), variant(MOVE_NONE),
+             lastMove(MOVE_NONE), moveSee(VALUE_NONE), variantSee(VALUE_NONE),
+             princessSquare(promoting_princess(p)), threshold(th) {
 
   assert(!pos.checkers());
 
@@ -103,8 +118,11 @@ void MovePicker::score() {
   for (auto& m : *this)
   {
       if (Type == CAPTURES)
+      {
           m.value =  int(PieceValue[MG][pos.piece_on(to_sq(m))]) * 6
                    + (*captureHistory)[pos.moved_piece(m)][to_sq(m)][type_of(pos.piece_on(to_sq(m)))];
+          m.see = VALUE_NONE;
+      }
 
       else if (Type == QUIETS)
           m.value =      (*mainHistory)[pos.side_to_move()][from_to(m)]
@@ -148,8 +166,72 @@ Move MovePicker::select(Pred filter) {
 /// MovePicker::next_move() is the most important method of the MovePicker class. It
 /// returns a new pseudo legal move every time it is called until there are no more
 /// moves left, picking the move with the highest score from a list of generated moves.
+/// After the queen has been captured, each move is followed by the same move with
+/// a princess promotion, so the generated lists are not doubled.
 Move MovePicker::next_move(bool skipQuiets) {
 
+  if (variant)
+  {
+      Move m = variant;
+      variant = MOVE_NONE;
+
+      if (!skipQuiets || stage != QUIET)
+      {
+          // The promotion does not change the exchange on the destination
+          lastMove = m;
+          moveSee = variantSee;
+          return m;
+      }
+  }
+
+  moveSee = VALUE_NONE;
+  Move m = lastMove = pick_move(skipQuiets);
+
+  if (   m
+      && princessSquare != SQ_NONE
+      && from_sq(m) != princessSquare
+      && !promote_princess(m))
+  {
+      Move v = Move(m | (1 << 20));
+
+      // The TT move and the refutations are returned by their own stages
+      if (   v != ttMove
+          && !(   (stage == REFUTATION || stage == QUIET)
+               && (   v == refutations[0].move
+                   || v == refutations[1].move
+                   || v == refutations[2].move)))
+      {
+          variant = v;
+          variantSee = moveSee;
+      }
+  }
+
+  return m;
+}
+
+/// MovePicker::see_ge() is Position::see_ge() for the move last returned by
+/// next_move(). The exchange value computed while picking the captures is
+/// reused, and the one of any other move is computed at most once.
+bool MovePicker::see_ge(Move m, Value th) {
+
+  if (m != lastMove)
+      return pos.see_ge(m, th);
+
+  if (moveSee == VALUE_NONE)
+  {
+      moveSee = pos.see(m);
+
+      if (variant && variant == Move(m | (1 << 20)))
+          variantSee = moveSee;
+  }
+
+  return moveSee >= th;
+}
+
+/// MovePicker::pick_move() walks through the stages and returns the next move
+/// of the generated lists, without the princess promotion variants.
+Move MovePicker::pick_move(bool skipQuiets) {
+
 top:
   switch (stage) {
 
@@ -172,10 +254,14 @@ top:
 
   case GOOD_CAPTURE:
       if (select<Best>([&](){
-                       return pos.see_ge(*cur, Value(-69 * cur->value / 1024)) ?
+                       cur->see = pos.see(*cur);
+                       return cur->see >= Value(-69 * cur->value / 1024) ?
                               // Move losing capture to endBadCaptures to be tried later
                               true : (*endBadCaptures++ = *cur, false); }))
+      {
+          moveSee = (cur - 1)->see;
           return *(cur - 1);
+      }
 
       // Prepare the pointers to loop over the refutations array
       cur = std::begin(refutations);
@@ -225,7 +311,12 @@ top:
       /* fallthrough */
 
   case BAD_CAPTURE:
-      return select<Next>([](){ return true; });
+      if (select<Next>([](){ return true; }))
+      {
+          moveSee = (cur - 1)->see;
+          return *(cur - 1);
+      }
+      return MOVE_NONE;
 
   case EVASION_INIT:
       cur = moves;
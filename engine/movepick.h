@@ -136,8 +136,10 @@ public:
                                            const Move*,
                                            int);
   Move next_move(bool skipQuiets = false);
+  bool see_ge(Move m, Value th = VALUE_ZERO);
 
 private:
+  Move pick_move(bool skipQuiets);
   template<PickType T, typename Pred> Move select(Pred);
   template<GenType> void score();
   ExtMove* begin() { return cur; }
@@ -148,8 +150,10 @@ private:
   const LowPlyHistory* lowPlyHistory;
   const CapturePieceToHistory* captureHistory;
   const PieceToHistory** continuationHistory;
-  Move ttMove;
+  Move ttMove, variant, lastMove;
+  Value moveSee, variantSee;
   ExtMove refutations[3], *cur, *endMoves, *endBadCaptures;
+  Square princessSquare;
   int stage;
   Square recaptureSquare;
   Value threshold;
@@ -87,10 +87,12 @@ void Position::init() {
 
   for (Piece pc : Pieces)
       for (Square s = SQ_A1; s <= SQ_J10; ++s)
-          Zobrist::psq[pc][s] = rng.rand<Key>();
+          if (is_ok(s))
+              Zobrist::psq[pc][s] = rng.rand<Key>();
 
   for (Square s = SQ_A1; s <= SQ_J10; ++s)
-      Zobrist::enpassant[s] = rng.rand<Key>();
+      if (is_ok(s))
+          Zobrist::enpassant[s] = rng.rand<Key>();
 
   for (int cr = NO_CASTLING; cr <= ANY_CASTLING; ++cr)
   {
@@ -166,7 +168,7 @@ Position& Position::set(const string& fenStr, StateInfo* si, Thread* th) {
           sq += (token - '0') * EAST; // Advance the given number of files
 
       else if (token == '/')
-          sq += 2 * SOUTH;
+          sq += SOUTH + int(FILE_NB) * WEST;
 
       else if ((idx = PieceToChar.find(token)) != string::npos)
       {
@@ -262,7 +264,7 @@ Position& Position::set(const string& fenStr, StateInfo* si, Thread* th) {
         //std::cout << "<ep move2: " << fromFile << "," << fromRank << ","
                                    //<< toFile << "," << toRank << ">" << std::endl;
 
-        st->epMove = make_move(Square(fr * 10 + ff), Square(tr * 10 + tf));
+        st->epMove = make_move(make_square(File(ff), Rank(fr)), make_square(File(tf), Rank(tr)));
         //std::cout << "<ep move: " << from_sq(st->epMove) << "," << to_sq(st->epMove) << ">" << std::endl;
       }
     }
@@ -305,13 +307,42 @@ void Position::set_castling_right(Color c, Square rfrom) {
 }
 
 
-/// Position::set_check_info() sets king attacks to detect if a move gives check
+/// Position::set_check_info() sets king attacks to detect if a move gives check.
+/// Pins and blockers depend only on the queen rays from each king, royal jumps
+/// and walls included, so they are copied from the previous state when none of
+/// the 'changed' squares lies there.
 
-void Position::set_check_info(StateInfo* si) const {
+void Position::set_check_info(StateInfo* si, Bitboard changed) const {
 
-  si->blockersForKing[WHITE] = slider_blockers(pieces(BLACK), square<KING>(WHITE), si->pinners[BLACK]);
-  si->blockersForKing[BLACK] = slider_blockers(pieces(WHITE), square<KING>(BLACK), si->pinners[WHITE]);
+  for (Color c : { WHITE, BLACK })
+  {
+      Square ksq = square<KING>(c);
+
+      if ((PseudoAttacks[QUEEN][ksq] | ksq) & changed)
+          si->blockersForKing[c] = slider_blockers(pieces(~c), ksq, si->pinners[~c]);
+      else
+      {
+          si->blockersForKing[c] = si->previous->blockersForKing[c];
+          si->pinners[~c] = si->previous->pinners[~c];
+      }
 
+#ifndef NDEBUG
+      Bitboard pinners;
+      assert(si->blockersForKing[c] == slider_blockers(pieces(~c), ksq, pinners));
+      assert(si->pinners[~c] == pinners);
+#endif
+  }
+
+  Square ksq = square<KING>(~sideToMove);
+
+  si->checkSquares[PAWN]     = pawn_attacks_bb(~sideToMove, ksq);
+  si->checkSquares[KNIGHT]   = attacks_bb<KNIGHT>(ksq);
+  si->checkSquares[BISHOP]   = attacks_bb<BISHOP>(ksq, pieces());
+  si->checkSquares[ROOK]     = attacks_bb<ROOK>(ksq, pieces());
+  si->checkSquares[PRINCESS] = attacks_bb<PRINCESS>(ksq, pieces());
+  si->checkSquares[QUEEN]    = si->checkSquares[BISHOP] | si->checkSquares[ROOK];
+  si->checkSquares[PRINCE]   = attacks_bb<PRINCE>(ksq, pieces());
+  si->checkSquares[KING]     = attacks_bb<KING>(ksq);
 }
 
 
@@ -328,8 +359,9 @@ void Position::set_state(StateInfo* si) const {
 
   //if(!pieces(sideToMove, PRINCE))
       si->checkersBB = attackers_to(square<KING>(sideToMove)) & pieces(~sideToMove);
+  si->capturersBB = attackers_to(square<KING>(~sideToMove)) & pieces(sideToMove);
 
-  set_check_info(si);
+  set_check_info(si, AllSquares);
 
   for (Bitboard b = pieces(); b; )
   {
@@ -548,8 +580,48 @@ Bitboard Position::attackers_to(Square s, Bitboard occupied) const {
 }
 
 
-/// Position::legal() tests whether a pseudo-legal move is legal
+/// Position::evasion_target() returns the squares where a move other than a
+/// king move answers a single check: the checker itself, the squares between
+/// it and a slider, or the last open square of a royal jump.
+
+Bitboard Position::evasion_target() const {
+
+  assert(checkers() && !more_than_one(checkers()));
+
+  Square ksq = square<KING>(sideToMove);
+  Square checksq = lsb(checkers());
+  Bitboard target = checkers();
+
+  if ((pieces(BISHOP, ROOK) | pieces(QUEEN)) & checksq)
+      target |= between_bb(ksq, checksq);
+
+  else if (pieces(PRINCE, PRINCESS) & checksq)
+  {
+      if (attacks_bb<BISHOP>(checksq) & ksq) // Corner attack
+          target |= between_bb(ksq, checksq);
+
+      else if (distance(checksq, ksq) == 2)
+      {
+          Bitboard openblocks = royal_wall(checksq, ksq) & ~pieces();
+
+          // If all are blocked, there shouldn't even be a check
+          assert(openblocks);
+
+          // If more than one block is missing, can't help
+          if (!more_than_one(openblocks))
+              target |= openblocks;
+      }
+  }
+
+  return target;
+}
 
+
+/// Position::legal() tests whether a pseudo-legal move is legal. Without
+/// princes and princesses on the board (Royals == false) the king can never
+/// stay attacked, and the classic pin test replaces the royal rules.
+
+template<bool Royals>
 bool Position::legal(Move m) const {
 
   assert(is_ok(m));
@@ -613,11 +685,20 @@ bool Position::legal(Move m) const {
   }
 
   // If the king is under attack and this move doesn't attack it, illegal
-  Square enemyKsq = square<KING>(~us);
-  if (attackers_to(enemyKsq, pieces()) & pieces(us))
+  if (king_capturers() && to != square<KING>(~us))
+      return false;
+
+  if (!Royals)
   {
-      if (to != enemyKsq)
-          return false;
+      assert(!has_royals() && !promote_princess(m));
+
+      // The castling path has been checked above
+      if (pt == KING)
+          return   type_of(m) == CASTLING
+                || !(attackers_to(to, pieces() ^ from) & pieces(~us));
+
+      return   !(blockers_for_king(us) & from)
+            ||  aligned(from, to, square<KING>(us));
   }
 
   // If the moving piece is a king, check whether the destination square is
@@ -690,11 +771,12 @@ bool Position::legal(Move m) const {
   //std::cout << "<last test>";
   //If after a move, both kings are in check it's not legal.
   Square ourKsq = square<KING>(us) == from ? to : square<KING>(us);
-  Bitboard checkSquares = attacks_bb(pt, square<KING>(~us), pieces());
+  // Pawns do not count here
+  Bitboard checkSquares = pt == PAWN ? 0 : check_squares(pt);
 
   // if promotion, add more check squares
   if (type_of(m) == PROMOTION)
-      checkSquares |= attacks_bb(promotion_type(m), square<KING>(~us), pieces());
+      checkSquares |= check_squares(promotion_type(m));
 
   // Does this move check the other king?
   if (checkSquares & to)
@@ -737,6 +819,9 @@ bool Position::legal(Move m) const {
         ||  aligned(from, to, square<KING>(us));
 }
 
+template bool Position::legal<true>(Move m) const;
+template bool Position::legal<false>(Move m) const;
+
 
 /// Position::pseudo_legal() takes a random move and tests whether the move is
 /// pseudo legal. It is used to validate moves from TT that can be corrupted
@@ -750,42 +835,101 @@ bool Position::pseudo_legal(const Move m) const {
   Square to = to_sq(m);
   Piece pc = moved_piece(m);
 
-  if (promote_princess(m) && !queen_captured())
-      return false;
-
-  // Use a slower but simpler function for uncommon cases
-  if (type_of(m) != NORMAL)
-      return MoveList<LEGAL>(*this).contains(m);
+  // A princess promotion doubles any other move after a queen capture. From
+  // the princess square it is a move of the new queen herself.
+  if (promote_princess(m))
+  {
+      if (!queen_captured() || !pieces(us, PRINCESS))
+          return false;
 
-  // Is not a promotion, so promotion piece must be empty
-  if (promotion_type(m) - KNIGHT != NO_PIECE_TYPE)
-      return false;
+      if (from != square<PRINCESS>(us))
+          return pseudo_legal(Move(m & ~(1 << 20)));
+  }
 
   // If the 'from' square is not occupied by a piece belonging to the side to
   // move, the move is obviously not legal.
   if (pc == NO_PIECE || color_of(pc) != us)
       return false;
 
+  // When the enemy king can be captured, only the moves doing so are kept
+  if (king_capturers() && to != square<KING>(~us))
+      return false;
+
+  // Only promotions carry a promotion piece
+  if (type_of(m) != PROMOTION && promotion_type(m) != KNIGHT)
+      return false;
+
+  // Castling is encoded as the king capturing its own rook, and is never
+  // generated while in check.
+  if (type_of(m) == CASTLING)
+  {
+      CastlingRights cr = us & (to > from ? KING_SIDE : QUEEN_SIDE);
+
+      return   type_of(pc) == KING
+            && !checkers()
+            && can_castle(cr)
+            && castling_rook_square(cr) == to
+            && !castling_impeded(cr);
+  }
+
   // The destination square cannot be occupied by a friendly piece
   if (pieces(us) & to)
       return false;
 
+  // An en passant capture lands on any square the last multiple push passed
+  // over. In check, the pushed pawn must be the only checker.
+  if (type_of(m) == ENPASSANT)
+  {
+      Move ep = ep_move();
+
+      return   type_of(pc) == PAWN
+            && ep != MOVE_NONE
+            && (between_bb(from_sq(ep), to_sq(ep)) & EPRanks & to)
+            && (pawn_attacks_bb(us, from) & to)
+            && (!checkers() || checkers() == square_bb(to_sq(ep)));
+  }
+
+  if (type_of(m) == PROMOTION)
+  {
+      PieceType promotion = promotion_type(m);
+
+      if (   type_of(pc) != PAWN
+          || relative_rank(us, from) != RANK_9
+          || promotion == PRINCESS
+          || promotion > QUEEN)
+          return false;
+
+      if (   !(pawn_attacks_bb(us, from) & pieces(~us) & to) // Not a capture
+          && !((from + pawn_push(us) == to) && empty(to)))      // Not a push
+          return false;
+  }
+
   // Handle the special case of a pawn move
-  if (type_of(pc) == PAWN)
+  else if (type_of(pc) == PAWN)
   {
+      Direction up = pawn_push(us);
+      Rank r = relative_rank(us, from);
+
       // We have already handled promotion moves, so destination
-      // cannot be on the 8th/1st rank.
+      // cannot be on the 10th/1st rank.
       if ((Rank10BB | Rank1BB) & to)
           return false;
 
-      if (   !(pawn_attacks_bb(us, from) & pieces(~us) & to) // Not a capture
-          && !((from + pawn_push(us) == to) && empty(to))       // Not a single push
-          && !(   (from + 2 * pawn_push(us) == to)              // Not a double push
-               && (relative_rank(us, from) == RANK_2)
-               && empty(to)
-               && empty(to - pawn_push(us))))
+      if (   !(pawn_attacks_bb(us, from) & pieces(~us) & to)         // Not a capture
+          && !(   (   from + up == to                                // Not a single push
+                   || (from + 2 * up == to && (r == RANK_2 || r == RANK_3)) // Not a double push
+                   || (from + 3 * up == to && r == RANK_2))          // Not a triple push
+               && !((between_bb(from, to) | to) & pieces())))
           return false;
   }
+
+  // The new queen moves like one from the princess square
+  else if (promote_princess(m))
+  {
+      if (!(attacks_bb<QUEEN>(from, pieces()) & to))
+          return false;
+  }
+
   else if (!(attacks_bb(type_of(pc), from, pieces()) & to))
       return false;
 
@@ -801,13 +945,35 @@ bool Position::pseudo_legal(const Move m) const {
               return false;
 
           // Our move must be a blocking evasion or a capture of the checking piece
-          if (!((between_bb(lsb(checkers()), square<KING>(us)) | checkers()) & to))
+          if (!(evasion_target() & to))
               return false;
       }
       // In case of king moves under check we have to remove king so as to catch
       // invalid moves like b1a1 when opposite queen is on c1.
-      else if (attackers_to(to, pieces() ^ from) & pieces(~us))
-          return false;
+      else if (!pieces(us, PRINCE))
+      {
+          if (attackers_to(to, pieces() ^ from) & pieces(~us))
+              return false;
+      }
+
+      // With a prince the king may stay attacked, but like the evasions
+      // generator we keep it off the lines of the checking sliders.
+      else
+      {
+          Bitboard sliders = checkers() & ~pieces(KNIGHT, PAWN);
+
+          while (sliders)
+          {
+              Square slider = pop_lsb(&sliders);
+              Bitboard b = line_bb(from, slider) & ~checkers();
+
+              if (pieces(~us, PRINCE, PRINCESS) & slider)
+                  b &= PseudoAttacks[PRINCE][slider];
+
+              if (b & to)
+                  return false;
+          }
+      }
   }
 
   return true;
@@ -829,7 +995,7 @@ bool Position::gives_check(Move m) const {
       return false;
 
   // Is there a direct check?
-  if (attacks_bb(type_of(piece_on(from)), square<KING>(~sideToMove), pieces()) & to)
+  if (check_squares(type_of(piece_on(from))) & to)
       return true;
 
   // Is there a discovered check?
@@ -851,7 +1017,7 @@ bool Position::gives_check(Move m) const {
   // the captured pawn.
   case ENPASSANT:
   {
-      Square capsq = make_square(file_of(to), rank_of(from));
+      Square capsq = to_sq(ep_move());
       Bitboard b = (pieces() ^ from ^ capsq) | to;
 
       return  (attacks_bb<  ROOK>(square<KING>(~sideToMove), b) & pieces(sideToMove, QUEEN, ROOK))
@@ -895,6 +1061,8 @@ bool Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   newSt.previous = st;
   st = &newSt;
 
+  Bitboard occupied = pieces();
+
   // Increment ply counters. In particular, rule50 will be reset to zero later on
   // in case of a capture or a pawn move.
   ++gamePly;
@@ -1157,13 +1325,24 @@ bool Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   st->key = k;
 
   // Calculate checkers bitboard (if move gives check)
-  // Extra careful here, as a PRINCE promotes to a KING and reverts
+  // Extra careful here, as a PRINCE promotes to a KING and reverts. Without
+  // royals a legal move never leaves our own king attacked.
   st->checkersBB = attackers_to(square<KING>(them)) & pieces(us);
+  st->capturersBB = has_royals() ? attackers_to(square<KING>(us)) & pieces(them) : 0;
 
   sideToMove = ~sideToMove;
 
-  // Update king attacks used for fast check detection
-  set_check_info(st);
+  // Update king attacks used for fast check detection. Besides the occupancy
+  // changes, the pieces can change on from/to and on the promoted royal squares.
+  Bitboard changed = (pieces() ^ occupied) | from | to;
+
+  if (st->princessSquare != SQ_NONE)
+      changed |= st->princessSquare;
+
+  if (type_of(captured) == KING)
+      changed |= square<KING>(them);
+
+  set_check_info(st, changed);
 
   // Calculate the repetition info. It is the ply distance from the previous
   // occurrence of the same position, negative in the 3-fold case, or zero
@@ -1344,9 +1523,126 @@ Key Position::key_after(Move m) const {
 }
 
 
+/// Position::perft_key() returns a key for the tree of legal moves from the
+/// position, used by perft to find transpositions. Unlike key() it holds the
+/// en passant move only when one of our pawns can take it, and then the whole
+/// move, since a double and a triple push can end on the same square. It also
+/// holds the princess promotion state, which is not in key().
+
+Key Position::perft_key() const {
+
+  Key k = st->key;
+  Key state =  Key(queen_captured())
+             | Key(st->princessRights[WHITE]) << 1
+             | Key(st->princessRights[BLACK]) << 2;
+
+  if (st->epMove != MOVE_NONE)
+  {
+      k ^= Zobrist::enpassant[to_sq(st->epMove)];
+
+      Bitboard eptargets = between_bb(from_sq(st->epMove), to_sq(st->epMove)) & EPRanks;
+      if (pawn_attacks_bb(~sideToMove, eptargets) & pieces(sideToMove, PAWN))
+          state |= Key(st->epMove) << 3;
+  }
+
+  return k ^ (state * 0x9E3779B97F4A7C15ULL);
+}
+
+
+/// Position::see() returns the Static Exchange Evaluation of a move: the
+/// material balance of the best capture sequence on the destination square,
+/// built with the usual swap list. Princes and princesses take part in the
+/// exchange, and removing any piece next to the square may open the jump
+/// gates of royal attackers behind it.
+
+Value Position::see(Move m) const {
+
+  assert(is_ok(m));
+
+  // Only deal with normal moves, assume others pass a simple see
+  if (type_of(m) != NORMAL)
+      return VALUE_ZERO;
+
+  Square from = from_sq(m), to = to_sq(m);
+
+  Value gain[64];
+  int d = 0;
+
+  gain[0] = PieceValue[MG][piece_on(to)];
+  Value onSquare = PieceValue[MG][piece_on(from)];
+
+  Bitboard occupied = pieces() ^ from ^ to;
+  Color stm = color_of(piece_on(from));
+  Bitboard attackers = attackers_to(to, occupied);
+  Bitboard stmAttackers, bb;
+
+  while (true)
+  {
+      stm = ~stm;
+      attackers &= occupied;
+
+      // If stm has no more attackers then the exchange is over
+      if (!(stmAttackers = attackers & pieces(stm)))
+          break;
+
+      // Don't allow pinned pieces to attack (except the king) as long as
+      // there are pinners on their original square.
+      if (pinners(~stm) & occupied)
+          stmAttackers &= ~blockers_for_king(stm);
+
+      if (!stmAttackers)
+          break;
+
+      // Locate the next least valuable attacker. The king goes last and
+      // may only capture when the opponent has no attackers left.
+      Value value;
+
+      if      ((bb = stmAttackers & pieces(PAWN)))     value = PawnValueMg;
+      else if ((bb = stmAttackers & pieces(KNIGHT)))   value = KnightValueMg;
+      else if ((bb = stmAttackers & pieces(BISHOP)))   value = BishopValueMg;
+      else if ((bb = stmAttackers & pieces(ROOK)))     value = RookValueMg;
+      else if ((bb = stmAttackers & pieces(PRINCESS))) value = PrincessValueMg;
+      else if ((bb = stmAttackers & pieces(QUEEN)))    value = QueenValueMg;
+      else if ((bb = stmAttackers & pieces(PRINCE)))   value = PrinceValueMg;
+      else
+      {
+          if (attackers & ~pieces(stm))
+              break;
+
+          bb = stmAttackers & pieces(KING);
+          value = KingValueMg;
+      }
+
+      ++d;
+      gain[d] = onSquare - gain[d - 1];
+      onSquare = value;
+
+      // Remove the attacker, and add to the bitboard 'attackers' any X-ray
+      // attackers behind it. Knights are never in the way of anything.
+      Square s = lsb(bb);
+      occupied ^= s;
+
+      if (!(pieces(KNIGHT) & s))
+          attackers |=  (attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN))
+                      | (attacks_bb<ROOK  >(to, occupied) & pieces(ROOK  , QUEEN))
+                      | (royal_attacks(to, occupied) & pieces(PRINCE, PRINCESS));
+  }
+
+  // Each side may stop the exchange when continuing would lose material
+  while (d)
+  {
+      gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+      --d;
+  }
+
+  return gain[0];
+}
+
+
 /// Position::see_ge (Static Exchange Evaluation Greater or Equal) tests if the
 /// SEE value of move is greater or equal to the given threshold. We'll use an
-/// algorithm similar to alpha-beta pruning with a null window.
+/// algorithm similar to alpha-beta pruning with a null window, which stops as
+/// soon as the result is known. Attackers are taken in the order of see().
 
 bool Position::see_ge(Move m, Value threshold) const {
 
@@ -1391,57 +1687,32 @@ bool Position::see_ge(Move m, Value threshold) const {
 
       res ^= 1;
 
-      // Locate and remove the next least valuable attacker, and add to
-      // the bitboard 'attackers' any X-ray attackers behind it.
-      if ((bb = stmAttackers & pieces(PAWN)))
-      {
-          if ((swap = PawnValueMg - swap) < res)
-              break;
-
-          occupied ^= lsb(bb);
-          attackers |= attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN);
-      }
-
-      else if ((bb = stmAttackers & pieces(KNIGHT)))
-      {
-          if ((swap = KnightValueMg - swap) < res)
-              break;
-
-          occupied ^= lsb(bb);
-      }
-
-      else if ((bb = stmAttackers & pieces(BISHOP)))
-      {
-          if ((swap = BishopValueMg - swap) < res)
-              break;
-
-          occupied ^= lsb(bb);
-          attackers |= attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN);
-      }
-
-      else if ((bb = stmAttackers & pieces(ROOK)))
-      {
-          if ((swap = RookValueMg - swap) < res)
-              break;
-
-          occupied ^= lsb(bb);
-          attackers |= attacks_bb<ROOK>(to, occupied) & pieces(ROOK, QUEEN);
-      }
-
-      else if ((bb = stmAttackers & pieces(QUEEN)))
-      {
-          if ((swap = QueenValueMg - swap) < res)
-              break;
-
-          occupied ^= lsb(bb);
-          attackers |=  (attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN))
-                      | (attacks_bb<ROOK  >(to, occupied) & pieces(ROOK  , QUEEN));
-      }
+      Value value;
 
+      if      ((bb = stmAttackers & pieces(PAWN)))     value = PawnValueMg;
+      else if ((bb = stmAttackers & pieces(KNIGHT)))   value = KnightValueMg;
+      else if ((bb = stmAttackers & pieces(BISHOP)))   value = BishopValueMg;
+      else if ((bb = stmAttackers & pieces(ROOK)))     value = RookValueMg;
+      else if ((bb = stmAttackers & pieces(PRINCESS))) value = PrincessValueMg;
+      else if ((bb = stmAttackers & pieces(QUEEN)))    value = QueenValueMg;
+      else if ((bb = stmAttackers & pieces(PRINCE)))   value = PrinceValueMg;
       else // KING
            // If we "capture" with the king but opponent still has attackers,
            // reverse the result.
           return (attackers & ~pieces(stm)) ? res ^ 1 : res;
+
+      if ((swap = value - swap) < res)
+          break;
+
+      // Remove the attacker, and add to the bitboard 'attackers' any X-ray
+      // attackers behind it. Knights are never in the way of anything.
+      Square s = lsb(bb);
+      occupied ^= s;
+
+      if (!(pieces(KNIGHT) & s))
+          attackers |=  (attacks_bb<BISHOP>(to, occupied) & pieces(BISHOP, QUEEN))
+                      | (attacks_bb<ROOK  >(to, occupied) & pieces(ROOK  , QUEEN))
+                      | (royal_attacks(to, occupied) & pieces(PRINCE, PRINCESS));
   }
 
   return bool(res);
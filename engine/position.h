@@ -41,19 +41,21 @@ struct StateInfo {
   Key    materialKey;
   Value  nonPawnMaterial[COLOR_NB];
   int    castlingRights;
-  bool   princessRights[COLOR_NB];
   int    rule50;
   int    pliesFromNull;
   Move   epMove;
   Square princessSquare;
+  bool   princessRights[COLOR_NB];
 
   // Not copied when making a move (will be recomputed anyhow)
   Key        key;
-  Bitboard   checkersBB;
-  Piece      capturedPiece;
   StateInfo* previous;
+  Bitboard   checkersBB;
+  Bitboard   capturersBB;
   Bitboard   blockersForKing[COLOR_NB];
   Bitboard   pinners[COLOR_NB];
+  Bitboard   checkSquares[KING + 1];
+  Piece      capturedPiece;
   int        repetition;
 };
 
@@ -109,11 +111,16 @@ public:
   bool queen_captured() const;
   bool previous_queen_captured() const;
   bool princess_rights(Color c) const;
+  bool has_royals() const;
 
   // Checking
   Bitboard checkers() const;
+  Bitboard king_attackers() const;
+  Bitboard king_capturers() const;
   Bitboard blockers_for_king(Color c) const;
   Bitboard pinners(Color c) const;
+  Bitboard check_squares(PieceType pt) const;
+  Bitboard evasion_target() const;
   bool is_discovery_check_on_king(Color c, Move m) const;
 
   // Attacks to/from a given square
@@ -122,6 +129,7 @@ public:
   Bitboard slider_blockers(Bitboard sliders, Square s, Bitboard& pinners) const;
 
   // Properties of moves
+  template<bool Royals> bool legal(Move m) const;
   bool legal(Move m) const;
   bool pseudo_legal(const Move m) const;
   bool capture(Move m) const;
@@ -142,11 +150,13 @@ public:
   void undo_move(Move m);
 
   // Static Exchange Evaluation
+  Value see(Move m) const;
   bool see_ge(Move m, Value threshold = VALUE_ZERO) const;
 
   // Accessing hash keys
   Key key() const;
   Key key_after(Move m) const;
+  Key perft_key() const;
   Key material_key() const;
   Key pawn_key() const;
 
@@ -171,7 +181,7 @@ private:
   // Initialization helpers (used while setting up a position)
   void set_castling_right(Color c, Square rfrom);
   void set_state(StateInfo* si) const;
-  void set_check_info(StateInfo* si) const;
+  void set_check_info(StateInfo* si, Bitboard changed) const;
 
   // Other helpers
   void put_piece(Piece pc, Square s);
@@ -180,19 +190,20 @@ private:
   template<bool Do>
   void do_castling(Color us, Square from, Square& to, Square& rfrom, Square& rto);
 
-  // Data members
-  Piece board[SQUARE_NB];
-  Bitboard byTypeBB[PIECE_TYPE_NB];
+  // Data members, the ones used at every node first
+  Bitboard byTypeBB[KING + 1];
   Bitboard byColorBB[COLOR_NB];
-  int pieceCount[PIECE_NB];
-  int castlingRightsMask[SQUARE_NB];
+  StateInfo* st;
+  Color sideToMove;
+  Score psq;
+  Piece board[SQUARE_NB];
+  uint8_t pieceCount[PIECE_NB];
+  uint8_t royalSquare[PIECE_NB];
+  uint8_t castlingRightsMask[SQUARE_NB];
   Square castlingRookSquare[CASTLING_RIGHT_NB];
   Bitboard castlingPath[CASTLING_RIGHT_NB];
   int gamePly;
-  Color sideToMove;
-  Score psq;
   Thread* thisThread;
-  StateInfo* st;
 };
 
 namespace PSQT {
@@ -248,6 +259,15 @@ template<PieceType Pt> inline int Position::count() const {
 
 template<PieceType Pt> inline Square Position::square(Color c) const {
   assert(pieceCount[make_piece(c, Pt)] == 1);
+
+  // Royal pieces are unique per side, so put_piece() and move_piece() keep
+  // their squares and we skip the bit scan. remove_piece() leaves it stale.
+  if (Pt == KING || Pt == PRINCE || Pt == PRINCESS)
+  {
+      assert(royalSquare[make_piece(c, Pt)] == lsb(pieces(c, Pt)));
+      return Square(royalSquare[make_piece(c, Pt)]);
+  }
+
   return lsb(pieces(c, Pt));
 }
 
@@ -315,6 +335,27 @@ inline Bitboard Position::checkers() const {
   return st->checkersBB;
 }
 
+/// Position::king_attackers() returns the enemy pieces attacking our king,
+/// even when a prince allows the check to be ignored.
+
+inline Bitboard Position::king_attackers() const {
+  return st->checkersBB;
+}
+
+/// Position::king_capturers() returns our pieces attacking the enemy king.
+/// If there are any, the only legal moves are the captures of that king.
+
+inline Bitboard Position::king_capturers() const {
+  return st->capturersBB;
+}
+
+/// Position::has_royals() tells whether a prince or a princess is on the board.
+/// Neither can come back once they are gone, and the game is then classic chess.
+
+inline bool Position::has_royals() const {
+  return pieces(PRINCE) | pieces(PRINCESS);
+}
+
 inline Bitboard Position::blockers_for_king(Color c) const {
   if (!pieces(c, PRINCE))
       return st->blockersForKing[c];
@@ -327,6 +368,12 @@ inline Bitboard Position::pinners(Color c) const {
   return 0;
 }
 
+/// Position::check_squares() returns the squares from where a piece of the
+/// given type, moved by the side to move, would attack the enemy king.
+inline Bitboard Position::check_squares(PieceType pt) const {
+  return st->checkSquares[pt];
+}
+
 
 inline bool Position::is_discovery_check_on_king(Color c, Move m) const {
   return blockers_for_king(c) & from_sq(m);
@@ -383,6 +430,10 @@ inline bool Position::opposite_bishops() const {
         && opposite_colors(square<BISHOP>(WHITE), square<BISHOP>(BLACK));
 }
 
+inline bool Position::legal(Move m) const {
+  return has_royals() ? legal<true>(m) : legal<false>(m);
+}
+
 inline bool Position::capture_or_promotion(Move m) const {
   assert(is_ok(m));
   return type_of(m) != NORMAL ? type_of(m) != CASTLING : !empty(to_sq(m));
@@ -408,6 +459,7 @@ inline void Position::put_piece(Piece pc, Square s) {
   byTypeBB[ALL_PIECES] |= byTypeBB[type_of(pc)] |= s;
   byColorBB[color_of(pc)] |= s;
   pieceCount[pc]++;
+  royalSquare[pc] = s;
   pieceCount[make_piece(color_of(pc), ALL_PIECES)]++;
   psq += PSQT::psq[pc][s];
 }
@@ -439,6 +491,7 @@ inline void Position::move_piece(Square from, Square to) {
   byColorBB[color_of(pc)] ^= fromTo;
   board[from] = NO_PIECE;
   board[to] = pc;
+  royalSquare[pc] = to;
   psq += PSQT::psq[pc][to] - PSQT::psq[pc][from];
 }
 
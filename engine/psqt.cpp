@@ -149,6 +149,9 @@ void init() {
 
       for (Square s = SQ_A1; s <= SQ_J10; ++s)
       {
+          if (!is_ok(s))
+              continue;
+
           File f = File(edge_distance(file_of(s)));
           psq[ pc][s] = score + (type_of(pc) == PAWN ? PBonus[rank_of(s)][file_of(s)]
                                                      : Bonus[pc][rank_of(s)][f]);
@@ -23,6 +23,7 @@
 #include <cmath>
 #include <cstring>   // For std::memset
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 #include "evaluate.h"
@@ -35,11 +36,6 @@
 #include "timeman.h"
 #include "uci.h"
 
-namespace Search {
-
-  LimitsType Limits;
-}
-
 using std::string;
 using Eval::evaluate;
 using namespace Search;
@@ -58,11 +54,9 @@ namespace {
     return Value(227 * (d - improving));
   }
 
-  // Reductions lookup table, initialized at startup
-  int Reductions[MAX_MOVES]; // [depth or moveNumber]
-
-  Depth reduction(bool i, Depth d, int mn) {
-    int r = Reductions[d] * Reductions[mn];
+  // Reductions lookup table of the pool, initialized by Search::init()
+  Depth reduction(const ThreadPool& threads, bool i, Depth d, int mn) {
+    int r = threads.reductions[d] * threads.reductions[mn];
     return (r + 570) / 1024 + (!i && r > 1018);
   }
 
@@ -96,41 +90,119 @@ namespace {
   void update_all_stats(const Position& pos, Stack* ss, Move bestMove, Value bestValue, Value beta, Square prevSq,
                         Move* quietsSearched, int quietCount, Move* capturesSearched, int captureCount, Depth depth);
 
-  // perft() is our utility to verify move generation. All the leaf nodes up
-  // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
-  uint64_t perft(Position& pos, Depth depth) {
+  // PerftTable caches the perft counts of the subtrees, shared by all the
+  // threads. Each entry keeps its key xored with the count, so that an entry
+  // torn by a concurrent write fails the key test instead of giving a wrong
+  // count. Entries are always replaced.
+  class PerftTable {
+
+    struct Entry {
+      Key keyXorNodes;
+      uint64_t nodes;
+    };
+
+  public:
+    ~PerftTable() { aligned_ttmem_free(mem); }
+
+    void resize(size_t mbSize) {
+
+      size_t count = 0;
+      while (mbSize && (count ? 2 * count : 1) * sizeof(Entry) <= mbSize * 1024 * 1024)
+          count = count ? 2 * count : 1;
+
+      if (count == entryCount)
+          return;
+
+      aligned_ttmem_free(mem);
+      table = count ? static_cast<Entry*>(aligned_ttmem_alloc(count * sizeof(Entry), mem)) : nullptr;
+
+      if (count && !table)
+      {
+          std::cerr << "Failed to allocate " << mbSize
+                    << "MB for the perft hash table." << std::endl;
+          exit(EXIT_FAILURE);
+      }
+
+      entryCount = count;
+      clear();
+    }
+
+    void clear() {
+      if (table)
+          std::memset(table, 0, entryCount * sizeof(Entry));
+    }
+
+    bool probe(Key key, uint64_t& nodes) const {
+
+      if (!table)
+          return false;
+
+      const Entry& e = table[key & (entryCount - 1)];
+      nodes = e.nodes;
+      return (e.keyXorNodes ^ nodes) == key;
+    }
+
+    void store(Key key, uint64_t nodes) {
+
+      if (!table)
+          return;
+
+      Entry& e = table[key & (entryCount - 1)];
+      e.keyXorNodes = key ^ nodes;
+      e.nodes = nodes;
+    }
+
+  private:
+    Entry* table = nullptr;
+    void* mem = nullptr;
+    size_t entryCount = 0;
+  };
+
+  PerftTable PerftTT;
+  std::vector<uint64_t> PerftCounts;
+  std::atomic<size_t> PerftNext;
+
+  // perft_split() is run by every thread on 'go perft'. The root moves are
+  // handed out one at a time, and the count of each one is saved for the
+  // divide output. Returns the number of nodes counted by this thread.
+  uint64_t perft_split(Position& pos, const RootMoves& rootMoves, Depth depth) {
 
     StateInfo st;
-    uint64_t cnt, nodes = 0;
-    const bool leaf = (depth == 2);
+    uint64_t nodes = 0;
+    size_t i;
 
-    for (const auto& m : MoveList<LEGAL>(pos))
+    while ((i = PerftNext++) < rootMoves.size())
     {
-        if (Root && depth <= 1)
-            cnt = 1, nodes++;
-        else
+        Move m = rootMoves[i].pv[0];
+        uint64_t cnt = 1;
+
+        if (depth > 1)
         {
             pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - 1);
-            nodes += cnt;
+            cnt = Search::perft(pos, depth - 1);
             pos.undo_move(m);
         }
-        if (Root)
-            sync_cout << UCI::move(m) << ": " << cnt << sync_endl;
+
+        PerftCounts[i] = cnt;
+        nodes += cnt;
     }
+
     return nodes;
   }
 
 } // namespace
 
 
-/// Search::init() is called at startup to initialize various lookup tables
+/// Search::init() is called before a search to initialize the lookup tables of
+/// the pool, which depend on the number of threads searching together: one for
+/// each thread of a batch.
+
+void Search::init(ThreadPool& threads) {
 
-void Search::init() {
+  size_t searching = threads.limits.batch ? 1 : threads.size();
 
   for (int i = 1; i < MAX_MOVES; ++i)
-      Reductions[i] = int((24.8 + std::log(Threads.size())) * std::log(i));
+      threads.reductions[i] = int((24.8 + std::log(searching)) * std::log(i));
 }
 
 
@@ -138,10 +210,61 @@ void Search::init() {
 
 void Search::clear() {
 
-  Threads.main()->wait_for_search_finished();
-
-  Time.availableNodes = 0;
   Threads.clear();
+  PerftTT.clear();
+}
+
+
+/// Search::perft() is our utility to verify move generation. All the leaf nodes
+/// up to the given depth are generated and counted, and the sum is returned.
+/// The last ply is counted in bulk from the size of the move lists.
+
+uint64_t Search::perft(Position& pos, Depth depth) {
+
+  if (depth == 1)
+      return MoveList<LEGAL>(pos).size();
+
+  Key key = pos.perft_key() ^ (Key(depth) * 0xD6E8FEB86659FD93ULL);
+  uint64_t nodes;
+
+  if (PerftTT.probe(key, nodes))
+      return nodes;
+
+  StateInfo st;
+  nodes = 0;
+
+  for (const auto& m : MoveList<LEGAL>(pos))
+  {
+      pos.do_move(m, st);
+      nodes += perft(pos, depth - 1);
+      pos.undo_move(m);
+  }
+
+  PerftTT.store(key, nodes);
+  return nodes;
+}
+
+
+/// Search::perft_reference() counts the same leaf nodes as perft() the plain
+/// way, making every move down to the leaves without any hashing or bulk
+/// counting. It is the reference when a perft suite entry fails.
+
+uint64_t Search::perft_reference(Position& pos, Depth depth) {
+
+  if (depth == 0)
+      return 1;
+
+  StateInfo st;
+  uint64_t nodes = 0;
+
+  for (const auto& m : MoveList<LEGAL>(pos))
+  {
+      pos.do_move(m, st);
+      nodes += perft_reference(pos, depth - 1);
+      pos.undo_move(m);
+  }
+
+  return nodes;
 }
 
 
@@ -150,15 +273,43 @@ void Search::clear() {
 
 void MainThread::search() {
 
-  if (Limits.perft)
+  // Perft splits the root moves among all the threads, and prints them with
+  // their counts once every thread is done.
+  if (threads.limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      TimePoint elapsed = now();
+
+      PerftTT.resize(size_t(Options["Perft Hash"]));
+      PerftCounts.assign(rootMoves.size(), 0);
+      PerftNext = 0;
+
+      threads.start_searching(); // start non-main threads
+      Thread::search();          // main thread start counting
+      threads.wait_for_search_finished();
+
+      elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+      uint64_t total = threads.nodes_searched();
+
+      if (threads.limits.silent)
+          return;
+
+      for (size_t i = 0; i < rootMoves.size(); ++i)
+          sync_cout << UCI::move(rootMoves[i].pv[0]) << ": " << PerftCounts[i] << sync_endl;
+
+      sync_cout << "\nNodes searched: " << total
+                << "\nNodes/second: " << 1000 * total / elapsed << "\n" << sync_endl;
       return;
   }
 
   Color us = rootPos.side_to_move();
-  Time.init(Limits, us, rootPos.game_ply());
+  threads.time.init(threads.limits, us, rootPos.game_ply());
+
+  // The timer stops the search on the clock, unless the time is counted in nodes
+  timer.arm(  threads.limits.npmsec                ? std::numeric_limits<TimePoint>::max()
+            : threads.limits.movetime              ? threads.limits.startTime + threads.limits.movetime
+            : threads.limits.use_time_management() ? threads.limits.startTime + threads.time.maximum() - 9
+                                                   : std::numeric_limits<TimePoint>::max());
 
   if (rootMoves.empty())
   {
@@ -168,8 +319,7 @@ void MainThread::search() {
       //Mate 2: (losing position): there are no moves, but we attack
       //the opponent king.
       //
-      bool isMate = rootPos.checkers() || 
-            (rootPos.attackers_to(rootPos.square<KING>(~us), rootPos.pieces()) & rootPos.pieces(us));
+      bool isMate = rootPos.checkers() || rootPos.king_capturers();
 
       sync_cout << "info depth 0 score "
                 << UCI::value(isMate ? -VALUE_MATE : VALUE_DRAW)
@@ -177,30 +327,35 @@ void MainThread::search() {
   }
   else
   {
-      Threads.start_searching(); // start non-main threads
+      threads.start_searching(); // start non-main threads
       Thread::search();          // main thread start searching
   }
 
   // When we reach the maximum depth, we can arrive here without a raise of
-  // Threads.stop. However, if we are pondering or in an infinite search,
+  // threads.stop. However, if we are pondering or in an infinite search,
   // the UCI protocol states that we shouldn't print the best move before the
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
+  while (!threads.stop && (ponder || threads.limits.infinite))
   {} // Busy wait for a stop or a ponder reset
 
+  int64_t searchEnd = now_micros();
+
   // Stop the threads if not already stopped (also raise the stop if
-  // "ponderhit" just reset Threads.ponder).
-  Threads.stop = true;
+  // "ponderhit" just reset threads.ponder), and wake up the ones of a paused
+  // pool, which would otherwise wait for the scheduler.
+  threads.stop = true;
+  threads.resume();
 
   // Wait until all threads have finished
-  Threads.wait_for_search_finished();
+  threads.wait_for_search_finished();
+  TimePoint stopTime = timer.disarm();
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
+  if (threads.limits.npmsec)
+      threads.time.availableNodes += threads.limits.inc[us] - threads.nodes_searched();
 
   Thread* bestThread = this;
 
@@ -216,6 +371,17 @@ void MainThread::search() {
       std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1]);
 
   std::cout << sync_endl;
+
+  // On the clock, measure how late "bestmove" left after the search was due to
+  // stop, which is when the timer stopped it or else when it ended by itself.
+  if (   (threads.limits.use_time_management() || threads.limits.movetime)
+      && !threads.limits.npmsec
+      && !ponder)
+      threads.time.add_latency(threads.limits.commandLatency,
+                               now_micros() - (stopTime ? stopTime * 1000 : searchEnd));
+
+  if (threads.searchFinished)
+      threads.searchFinished();
 }
 
 
@@ -225,6 +391,14 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  // On 'go perft' every thread counts a share of the root moves, and leaves
+  // the count in 'nodes', which do_move() has been increasing meanwhile.
+  if (threads.limits.perft)
+  {
+      nodes = perft_split(rootPos, rootMoves, threads.limits.perft);
+      return;
+  }
+
   // To allow access to (ss-7) up to (ss+2), the stack must be oversized.
   // The former is needed to allow update_continuation_histories(ss-1, ...),
   // which accesses its argument at ss-6, also near the root.
@@ -234,8 +408,8 @@ void Thread::search() {
   Value bestValue, alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
-  double timeReduction = 1, totBestMoveChanges = 0;
+  MainThread* mainThread = (this == threads.main() && !threads.limits.batch ? threads.main() : nullptr);
+  double timeReduction = 1, totBestMoveChanges = 0, lastNodesEffort = 0;
   int iterIdx = 0;
 
   std::memset(ss-7, 0, 10 * sizeof(Stack));
@@ -268,9 +442,12 @@ void Thread::search() {
 
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !threads.stop
+         && !(threads.limits.depth && (mainThread || threads.limits.batch) && rootDepth > threads.limits.depth))
   {
+      // A paused pool lends its cores to another search, see UCI "session"
+      threads.wait_while_paused();
+
       // Age out PV variability metric
       if (mainThread)
           totBestMoveChanges /= 2;
@@ -278,16 +455,21 @@ void Thread::search() {
       // Save the last iteration's scores before first PV line is searched and
       // all the move scores except the (new) PV are set to -VALUE_INFINITE.
       for (RootMove& rm : rootMoves)
+      {
           rm.previousScore = rm.score;
+          rm.previousEffort = rm.effort;
+      }
+
+      uint64_t previousNodes = nodes;
 
       size_t pvFirst = 0;
       pvLast = 0;
 
-      if (!Threads.increaseDepth)
+      if (!threads.increaseDepth)
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !threads.stop; ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -329,7 +511,7 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (threads.stop)
                   break;
 
               // When failing high/low give some update (without cluttering
@@ -337,7 +519,7 @@ void Thread::search() {
               if (   mainThread
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
+                  && threads.time.elapsed() > 3000)
                   sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
 
               // In case of failing low/high increase aspiration window and
@@ -371,11 +553,11 @@ void Thread::search() {
           std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
+              && (threads.stop || pvIdx + 1 == multiPV || threads.time.elapsed() > 3000))
               sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
       }
 
-      if (!Threads.stop)
+      if (!threads.stop)
           completedDepth = rootDepth;
 
       if (rootMoves[0].pv[0] != lastBestMove) {
@@ -384,17 +566,17 @@ void Thread::search() {
       }
 
       // Have we found a "mate in x"?
-      if (   Limits.mate
+      if (   threads.limits.mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
-          && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          && VALUE_MATE - bestValue <= 2 * threads.limits.mate)
+          threads.stop = true;
 
       if (!mainThread)
           continue;
 
       // Do we have time for the next iteration? Can we stop searching now?
-      if (    Limits.use_time_management()
-          && !Threads.stop
+      if (    threads.limits.use_time_management()
+          && !threads.stop
           && !mainThread->stopOnPonderhit)
       {
           double fallingEval = (296 + 6 * (mainThread->bestPreviousScore - bestValue)
@@ -406,32 +588,54 @@ void Thread::search() {
           double reduction = (1.47 + mainThread->previousTimeReduction) / (2.22 * timeReduction);
 
           // Use part of the gained time from a previous stable move for the current move
-          for (Thread* th : Threads)
+          for (Thread* th : threads)
           {
               totBestMoveChanges += th->bestMoveChanges;
               th->bestMoveChanges = 0;
           }
-          double bestMoveInstability = 1 + totBestMoveChanges / Threads.size();
+          double bestMoveInstability = 1 + totBestMoveChanges / threads.size();
 
           double totalTime = rootMoves.size() == 1 ? 0 :
-                             Time.optimum() * fallingEval * reduction * bestMoveInstability;
+                             threads.time.optimum() * fallingEval * reduction * bestMoveInstability;
+
+          // The move is easy if it has taken nearly all the nodes of the last two
+          // iterations: the other moves were refuted quickly.
+          double nodesEffort = (rootMoves[0].effort - rootMoves[0].previousEffort) * 100.0
+                             / std::max(uint64_t(nodes) - previousNodes, uint64_t(1));
+
+          bool easyMove =   nodesEffort >= 90
+                         && lastNodesEffort >= 90
+                         && lastBestMoveDepth < completedDepth;
+          lastNodesEffort = nodesEffort;
 
           // Stop the search if we have exceeded the totalTime, at least 1ms search
-          if (Time.elapsed() > totalTime)
+          if (threads.time.elapsed() > totalTime)
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
               if (mainThread->ponder)
                   mainThread->stopOnPonderhit = true;
               else
-                  Threads.stop = true;
+                  threads.stop = true;
           }
-          else if (   Threads.increaseDepth
+
+          // Stop an easy move halfway, a further iteration is unlikely to change it.
+          // The saved time is left on the clock for the positions where we are unsure.
+          else if (   threads.limits.effortStop
+                   && easyMove
+                   && completedDepth >= 10
+                   && !mainThread->ponder
+                   && threads.time.elapsed() > totalTime * 0.5)
+          {
+              threads.stop = true;
+              ++mainThread->effortStops;
+          }
+          else if (   threads.increaseDepth
                    && !mainThread->ponder
-                   && Time.elapsed() > totalTime * 0.56)
-                   Threads.increaseDepth = false;
+                   && threads.time.elapsed() > totalTime * 0.56)
+                   threads.increaseDepth = false;
           else
-                   Threads.increaseDepth = true;
+                   threads.increaseDepth = true;
       }
 
       mainThread->iterValue[iterIdx] = bestValue;
@@ -477,6 +681,7 @@ namespace {
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
+    ThreadPool& threads = thisThread->threads;
     ss->inCheck = pos.checkers();
     priorCapture = pos.captured_piece();
     Color us = pos.side_to_move();
@@ -485,7 +690,7 @@ namespace {
     maxValue = VALUE_INFINITE;
 
     // Check for the available remaining time
-    if (thisThread == Threads.main())
+    if (thisThread == threads.main())
         static_cast<MainThread*>(thisThread)->check_time();
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
@@ -495,7 +700,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   threads.stop.load(std::memory_order_relaxed)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -603,8 +808,8 @@ moves_loop: // When in check, search starts from here
 
       ss->moveCount = ++moveCount;
 
-      if (rootNode && (thisThread == Threads.main()) && Time.elapsed() > 3000
-                   && (Time.elapsed() % 8 == 1))
+      if (rootNode && thisThread == threads.main() && !threads.limits.batch && threads.time.elapsed() > 3000
+                   && (threads.time.elapsed() % 8 == 1))
           sync_cout << "info depth " << depth
                     << " currmove " << UCI::move(move)
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -628,7 +833,7 @@ moves_loop: // When in check, search starts from here
           moveCountPruning = moveCount >= futility_move_count(improving, depth);
 
           // Reduced depth of the next LMR search
-          int lmrDepth = std::max(newDepth - reduction(improving, depth, moveCount), 0);
+          int lmrDepth = std::max(newDepth - reduction(threads, improving, depth, moveCount), 0);
 
           if (   !captureOrPromotion
               && !givesCheck)
@@ -654,7 +859,7 @@ moves_loop: // When in check, search starts from here
               }
 
               // Prune moves with negative SEE (~20 Elo)
-              if (!pos.see_ge(move, Value(-(29 - std::min(lmrDepth, 17)) * lmrDepth * lmrDepth)))
+              if (!mp.see_ge(move, Value(-(29 - std::min(lmrDepth, 17)) * lmrDepth * lmrDepth)))
               {
                   continue;
               }
@@ -682,7 +887,7 @@ moves_loop: // When in check, search starts from here
               }
 
               // See based pruning
-              if (!pos.see_ge(move, Value(-202) * depth)) // (~25 Elo)
+              if (!mp.see_ge(move, Value(-202) * depth)) // (~25 Elo)
                   continue;
           }
       } 
@@ -691,7 +896,7 @@ moves_loop: // When in check, search starts from here
 
       // Check extension (~2 Elo)
       if (    givesCheck
-               && (pos.is_discovery_check_on_king(~us, move) || pos.see_ge(move)))
+               && (pos.is_discovery_check_on_king(~us, move) || mp.see_ge(move)))
           extension = 1;
 
       // Passed pawn extension
@@ -738,6 +943,7 @@ moves_loop: // When in check, search starts from here
       }
 
       // Step 15. Make the move
+      uint64_t nodeCount = rootNode ? uint64_t(thisThread->nodes) : 0;
       bool somethingBAD = pos.do_move(move, st, givesCheck);
 
       // Step 16. Reduced depth search (LMR, ~200 Elo). If the move fails high it will be
@@ -750,7 +956,7 @@ moves_loop: // When in check, search starts from here
               || ss->staticEval + PieceValue[EG][pos.captured_piece()] <= alpha
               || cutNode))
       {
-          Depth r = reduction(improving, depth, moveCount);
+          Depth r = reduction(threads, improving, depth, moveCount);
 
           if (moveCountPruning)
               r++;
@@ -862,7 +1068,7 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (threads.stop.load(std::memory_order_relaxed))
       {
           return VALUE_ZERO;
       }
@@ -872,6 +1078,8 @@ moves_loop: // When in check, search starts from here
           RootMove& rm = *std::find(thisThread->rootMoves.begin(),
                                     thisThread->rootMoves.end(), move);
 
+          rm.effort += thisThread->nodes - nodeCount;
+
           // PV move or new best move?
           if (moveCount == 1 || value > alpha)
           {
@@ -950,7 +1158,7 @@ moves_loop: // When in check, search starts from here
                 bestValue = mated_in(ss->ply);
             }
             //else //no legal moves, but piece that capture king are pinned
-            else if (pos.attackers_to(pos.square<KING>(~us), pos.pieces()) & pos.pieces(us))
+            else if (pos.king_capturers())
             {
                 bestValue = mated_in(ss->ply);
             }
@@ -1081,36 +1289,40 @@ moves_loop: // When in check, search starts from here
 } // namespace
 
 
-/// MainThread::check_time() is used to print debug info and, more importantly,
-/// to detect when we are out of available time and thus stop the search.
+/// MainThread::check_time() is used to detect when we are out of available nodes
+/// and thus stop the search. The clock is watched by the timer, except in 'nodes
+/// as time' mode where the elapsed time is counted in nodes too. The wasm build
+/// polls the timer from here, often enough that a stop is late by well under
+/// a millisecond rather than by the time of 1024 nodes.
 
 void MainThread::check_time() {
 
   if (--callsCnt > 0)
       return;
 
-  // When using nodes, ensure checking rate is not lower than 0.1% of nodes
-  callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
+#ifdef ROYAL_WASM
+  constexpr int CheckPeriod = 64;
+#else
+  constexpr int CheckPeriod = 1024;
+#endif
 
-  static TimePoint lastInfoTime = now();
+  // When using nodes, ensure checking rate is not lower than 0.1% of nodes
+  callsCnt = threads.limits.nodes ? std::min(CheckPeriod, int(threads.limits.nodes / 1024)) : CheckPeriod;
 
-  TimePoint elapsed = Time.elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
-
-  if (tick - lastInfoTime >= 1000)
-  {
-      lastInfoTime = tick;
-      dbg_print();
-  }
+#ifdef ROYAL_WASM
+  timer.poll();
+#endif
 
   // We should not stop pondering until told so by the GUI
   if (ponder)
       return;
 
-  if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
-      Threads.stop = true;
+  TimePoint elapsed = threads.limits.npmsec ? threads.time.elapsed() : 0;
+
+  if (   (threads.limits.npmsec && threads.limits.use_time_management() && (elapsed > threads.time.maximum() - 10 || stopOnPonderhit))
+      || (threads.limits.npmsec && threads.limits.movetime && elapsed >= threads.limits.movetime)
+      || (threads.limits.nodes && threads.nodes_searched() >= (uint64_t)threads.limits.nodes))
+      threads.stop = true;
 }
 
 
@@ -1120,12 +1332,13 @@ void MainThread::check_time() {
 string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
   std::stringstream ss;
-  TimePoint elapsed = Time.elapsed() + 1;
+  const ThreadPool& threads = pos.this_thread()->threads;
+  TimePoint elapsed = threads.time.elapsed() + 1;
   const RootMoves& rootMoves = pos.this_thread()->rootMoves;
   size_t pvIdx = pos.this_thread()->pvIdx;
   size_t multiPV = std::min((size_t)Options["MultiPV"], rootMoves.size());
-  uint64_t nodesSearched = Threads.nodes_searched();
-  uint64_t tbHits = Threads.tb_hits() + rootMoves.size();
+  uint64_t nodesSearched = threads.nodes_searched();
+  uint64_t tbHits = threads.tb_hits() + rootMoves.size();
 
   for (size_t i = 0; i < multiPV; ++i)
   {
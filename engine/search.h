@@ -28,6 +28,7 @@
 #include "types.h"
 
 class Position;
+struct ThreadPool;
 
 namespace Search {
 
@@ -72,6 +73,8 @@ struct RootMove {
   int selDepth = 0;
   int tbRank = 0;
   int bestMoveCount = 0;
+  uint64_t effort = 0; // Nodes spent on the move, over all the iterations
+  uint64_t previousEffort = 0;
   Value tbScore;
   std::vector<Move> pv;
 };
@@ -87,7 +90,9 @@ struct LimitsType {
   LimitsType() { // Init explicitly due to broken value-initialization of non POD in MSVC
     time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = TimePoint(0);
     movestogo = depth = mate = perft = infinite = 0;
-    nodes = 0;
+    nodes = commandLatency = 0;
+    silent = batch = false;
+    effortStop = false;
   }
 
   bool use_time_management() const {
@@ -98,12 +103,16 @@ struct LimitsType {
   TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
   int movestogo, depth, mate, perft, infinite;
   int64_t nodes;
+  int64_t commandLatency; // Microseconds from the arrival of "go" to startTime
+  bool silent; // Don't print the perft divide
+  bool batch;  // Every thread searches its own position, see UCI "batch"
+  bool effortStop; // Stop early when the best move took most of the nodes
 };
 
-extern LimitsType Limits;
-
-void init();
+void init(ThreadPool& threads);
 void clear();
+uint64_t perft(Position& pos, Depth depth);
+uint64_t perft_reference(Position& pos, Depth depth);
 
 } // namespace Search
 
@@ -21,6 +21,7 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <iostream>
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -28,11 +29,47 @@
 
 ThreadPool Threads; // Global object
 
+namespace {
+
+  // Threads are bound to processor groups or NUMA nodes only when there are
+  // enough of them, unless the "NUMA Binding" option says otherwise.
+  bool bind_threads() {
+    return    Options["NUMA Binding"] == "On"
+           || (Options["NUMA Binding"] == "Auto" && Options["Threads"] > 8);
+  }
+
+  // The binding slots taken by the threads of all the pools, so that the threads
+  // of the sessions are spread over the nodes with the ones of the global pool.
+  std::mutex SlotMutex;
+  std::vector<bool> SlotTaken;
+
+  size_t take_slot() {
+
+    std::lock_guard<std::mutex> lk(SlotMutex);
+
+    size_t s = std::find(SlotTaken.begin(), SlotTaken.end(), false) - SlotTaken.begin();
+
+    if (s == SlotTaken.size())
+        SlotTaken.push_back(true);
+    else
+        SlotTaken[s] = true;
+
+    return s;
+  }
+
+  void free_slot(size_t s) {
+
+    std::lock_guard<std::mutex> lk(SlotMutex);
+    SlotTaken[s] = false;
+  }
+
+} // namespace
+
 
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
 
-Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(ThreadPool& pool, size_t n) : idx(n), slot(take_slot()), stdThread(&Thread::idle_loop, this), threads(pool) {
 
 #ifndef ROYAL_WASM
   // https://github.com/niklasf/stockfish.wasm/blob/8ae1790bdb509791dcbadd1c0d23e5448cf9b204/src/thread.cpp#L40
@@ -51,6 +88,29 @@ Thread::~Thread() {
   exit = true;
   start_searching();
   stdThread.join();
+  free_slot(slot);
+}
+
+
+/// Thread::operator new() allocates the threads on large pages when possible,
+/// as most of their size is taken by the histories, accessed at random.
+
+void* Thread::operator new(size_t size) {
+
+  void* mem = aligned_large_pages_alloc(size);
+
+  if (!mem)
+  {
+      std::cerr << "Failed to allocate " << size / (1024 * 1024)
+                << "MB for a search thread." << std::endl;
+      std::exit(EXIT_FAILURE);
+  }
+
+  return mem;
+}
+
+void Thread::operator delete(void* p) {
+  aligned_large_pages_free(p);
 }
 
 
@@ -65,10 +125,12 @@ int Thread::best_move_count(Move move) const {
 }
 
 
-/// Thread::clear() reset histories, usually before a new game
+/// Thread::clear() reset histories, usually before a new game. The first call
+/// also allocates the pawn hash.
 
 void Thread::clear() {
 
+  pawnsTable.allocate();
   counterMoves.fill(MOVE_NONE);
   mainHistory.fill(0);
   lowPlyHistory.fill(0);
@@ -85,6 +147,32 @@ void Thread::clear() {
 }
 
 
+/// Thread::release() gives the memory of the pawn hash and of the histories back
+/// to the system, for a parked thread. The histories are filled again by the
+/// next clear().
+
+void Thread::release() {
+
+  pawnsTable.release();
+
+  char* begin = reinterpret_cast<char*>(&counterMoves);
+  char* end = reinterpret_cast<char*>(&continuationHistory) + sizeof(continuationHistory);
+
+  large_pages_discard(begin, size_t(end - begin));
+}
+
+
+/// Thread::bind() binds the calling thread, which must be this one, to the
+/// processor group or NUMA node of its slot, once. The slots number the threads
+/// of all the pools together, so that the sessions do not crowd the first node.
+
+void Thread::bind() {
+
+  if (!bound)
+      WinProcGroup::bindThisThread(slot), bound = true;
+}
+
+
 /// Thread::start_searching() wakes up the thread that will start the search
 
 void Thread::start_searching() {
@@ -95,6 +183,20 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::run_job() wakes up the thread to run the given function instead of
+/// a search. Completion is waited for with wait_for_search_finished().
+
+void Thread::run_job(std::function<void()> f) {
+
+  wait_for_search_finished();
+
+  std::lock_guard<std::mutex> lk(mutex);
+  job = std::move(f);
+  searching = true;
+  cv.notify_one(); // Wake up the thread in idle_loop()
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -115,9 +217,10 @@ void Thread::idle_loop() {
   // the choice, eventually we are one of many one-threaded processes running on
   // some Windows NUMA hardware, for instance in fishtest. To make it simple,
   // just check if running threads are below a threshold, in this case all this
-  // NUMA machinery is not needed.
-  if (Options["Threads"] > 8)
-      WinProcGroup::bindThisThread(idx);
+  // NUMA machinery is not needed. The "NUMA Binding" option may force it either
+  // way.
+  if (bind_threads())
+      bind();
 #endif
 
   while (true)
@@ -137,33 +240,194 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
-      search();
+      SyncTag = threads.tag;
+
+      if (job)
+      {
+          job();
+          job = nullptr;
+      }
+      else
+          search();
+  }
+}
+
+/// Timer constructor launches the timer thread, which sleeps until armed
+
+#ifndef ROYAL_WASM
+Timer::Timer(ThreadPool& pool) : threads(pool), stdThread(&Timer::idle_loop, this) {}
+#else
+Timer::Timer(ThreadPool& pool) : threads(pool) {}
+#endif
+
+
+/// Timer destructor wakes up the timer thread and waits for its termination
+
+Timer::~Timer() {
+
+  {
+      std::lock_guard<std::mutex> lk(mutex);
+      exit = true;
+  }
+
+  cv.notify_one();
+
+#ifndef ROYAL_WASM
+  stdThread.join();
+#endif
+}
+
+
+/// Timer::arm() sets the time at which the search is stopped. Pass a time
+/// beyond reach to only print the debug counters.
+
+void Timer::arm(TimePoint time) {
+
+  {
+      std::lock_guard<std::mutex> lk(mutex);
+      deadline = time;
+      stopTime = 0;
+      lastInfoTime = now();
+      armed = true;
+  }
+
+  cv.notify_one();
+}
+
+
+/// Timer::disarm() puts the timer back to sleep at the end of the search, and
+/// returns when the search was due to stop if the timer stopped it, else zero.
+
+TimePoint Timer::disarm() {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  armed = false;
+  return stopTime;
+}
+
+
+/// Timer::wake() makes the timer check again whether the search should stop,
+/// after the GUI has sent "ponderhit".
+
+void Timer::wake() {
+
+  { std::lock_guard<std::mutex> lk(mutex); }
+
+  cv.notify_one();
+}
+
+
+/// Timer::poll() does the work of the timer thread from the search, for the
+/// wasm build.
+
+void Timer::poll() {
+
+  std::lock_guard<std::mutex> lk(mutex);
+
+  if (armed)
+      expired(now());
+}
+
+
+/// Timer::expired() prints the debug counters every second, and stops the
+/// search once the deadline has passed. Called with the mutex held.
+
+bool Timer::expired(TimePoint tick) {
+
+  if (tick - lastInfoTime >= 1000)
+  {
+      lastInfoTime = tick;
+      dbg_print();
+  }
+
+  // We should not stop pondering until told so by the GUI
+  if (   !threads.main()->ponder
+      && (tick >= deadline || threads.main()->stopOnPonderhit))
+  {
+      threads.stop = true;
+      stopTime = std::min(tick, deadline);
+      armed = false;
+      return true;
+  }
+
+  return false;
+}
+
+
+/// Timer::idle_loop() is where the timer thread sleeps, either until armed or
+/// until the next deadline or debug print.
+
+void Timer::idle_loop() {
+
+  using namespace std::chrono;
+
+  std::unique_lock<std::mutex> lk(mutex);
+
+  while (!exit)
+  {
+      if (!armed)
+      {
+          cv.wait(lk);
+          continue;
+      }
+
+      if (expired(now()))
+          continue;
+
+      TimePoint wakeup = std::min(deadline, lastInfoTime + 1000);
+      cv.wait_until(lk, steady_clock::time_point(milliseconds(wakeup)));
   }
 }
 
-/// ThreadPool::set() creates/destroys threads to match the requested number.
-/// Created and launched threads will immediately go to sleep in idle_loop.
-/// Upon resizing, threads are recreated to allow for binding if necessary.
+
+/// ThreadPool::set() adds or parks threads to match the requested number, and
+/// destroys them all when zero is requested. Created and launched threads will
+/// immediately go to sleep in idle_loop. Upon resizing, the kept threads keep
+/// their tables, parked threads are reused first, and new threads fill their
+/// tables only at the next clear(), so that a resize costs little. Parked
+/// threads give the memory of their tables back until they are reused.
 
 void ThreadPool::set(size_t requested) {
 
-  if (size() > 0) { // destroy any existing thread(s)
+  if (size() > 0)
       main()->wait_for_search_finished();
 
-      while (size() > 0)
-          delete back(), pop_back();
+  while (size() > requested) // park or destroy the threads in excess
+  {
+      if (requested > 0)
+          back()->release(), parked.push_back(back());
+      else
+          delete back();
+
+      pop_back();
+  }
+
+  if (requested == 0)
+  {
+      while (!parked.empty())
+          delete parked.back(), parked.pop_back();
+
+      return;
   }
 
-  if (requested > 0) { // create new thread(s)
-      push_back(new MainThread(0));
+  while (size() < requested) // reuse parked threads, then create new ones
+      if (!parked.empty())
+          push_back(parked.back()), parked.pop_back();
+      else
+          push_back(size() ? new Thread(*this, size()) : new MainThread(*this, 0));
 
-      while (size() < requested)
-          push_back(new Thread(size()));
-      clear();
+#ifndef ROYAL_WASM
+  // Threads bind themselves when launched, but the others may have been
+  // launched in a pool too small for binding.
+  if (bind_threads())
+  {
+      for (Thread* th : *this)
+          th->run_job([th]() { th->bind(); });
 
-      // Init thread number dependent search params.
-      Search::init();
+      for (Thread* th : *this)
+          th->wait_for_search_finished();
   }
+#endif
 }
 
 
@@ -171,8 +435,22 @@ void ThreadPool::set(size_t requested) {
 
 void ThreadPool::clear() {
 
+  main()->wait_for_search_finished();
+  time.availableNodes = 0;
+
+#ifndef ROYAL_WASM
+  // Each thread clears its own histories. The pages of a new thread are thus
+  // first touched, and allocated by the OS, on the node where it runs. This
+  // must be done before a new thread searches.
+  for (Thread* th : *this)
+      th->run_job([th]() { th->clear(); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
+#else
   for (Thread* th : *this)
       th->clear();
+#endif
 
   main()->callsCnt = 0;
   main()->bestPreviousScore = VALUE_INFINITE;
@@ -180,18 +458,30 @@ void ThreadPool::clear() {
 }
 
 
+/// ThreadPool::release() gives the memory of the tables of the threads back to
+/// the system while the pool does not search. A session does it between its
+/// searches, as go clears the histories anyway.
+
+void ThreadPool::release() {
+
+  for (Thread* th : *this)
+      th->release();
+}
+
+
 /// ThreadPool::start_thinking() wakes up main thread waiting in idle_loop() and
 /// returns immediately. Main thread will wake up other threads and start the search.
 
 void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
-                                const Search::LimitsType& limits, bool ponderMode) {
+                                const Search::LimitsType& searchLimits, bool ponderMode) {
 
   main()->wait_for_search_finished();
 
-  main()->stopOnPonderhit = stop = false;
+  main()->stopOnPonderhit = stop = paused = false;
   increaseDepth = true;
   main()->ponder = ponderMode;
-  Search::Limits = limits;
+  limits = searchLimits;
+  Search::init(*this);
   Search::RootMoves rootMoves;
 
   for (const auto& m : MoveList<LEGAL>(pos))
@@ -276,3 +566,38 @@ void ThreadPool::wait_for_search_finished() const {
         if (th != front())
             th->wait_for_search_finished();
 }
+
+
+/// ThreadPool::pause() makes the threads of the pool wait at the start of their
+/// next iteration, until resume() or a stop, so that their cores can be lent to
+/// another search in the meantime.
+
+void ThreadPool::pause() {
+
+  std::lock_guard<std::mutex> lk(pauseMutex);
+  paused = true;
+}
+
+void ThreadPool::resume() {
+
+  {
+      std::lock_guard<std::mutex> lk(pauseMutex);
+      paused = false;
+  }
+
+  pauseCv.notify_all();
+}
+
+
+/// ThreadPool::wait_while_paused() is called by the threads between iterations.
+/// A stop must be followed by resume() to wake up the waiting threads, which
+/// the main thread does before it waits for the others.
+
+void ThreadPool::wait_while_paused() {
+
+  if (!paused)
+      return;
+
+  std::unique_lock<std::mutex> lk(pauseMutex);
+  pauseCv.wait(lk, [&]{ return !paused || stop; });
+}
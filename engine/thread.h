@@ -23,6 +23,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -32,6 +33,9 @@
 #include "position.h"
 #include "search.h"
 #include "thread_win32_osx.h"
+#include "timeman.h"
+
+struct ThreadPool;
 
 
 /// Thread class keeps together all the thread-related stuff. We use
@@ -43,17 +47,23 @@ class Thread {
 
   std::mutex mutex;
   std::condition_variable cv;
-  size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
+  size_t idx, slot;
+  bool exit = false, searching = true, bound = false; // Set before starting std::thread
+  std::function<void()> job;
   NativeThread stdThread;
 
 public:
-  explicit Thread(size_t);
+  Thread(ThreadPool&, size_t);
   virtual ~Thread();
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
   virtual void search();
   void clear();
+  void release();
+  void bind();
   void idle_loop();
   void start_searching();
+  void run_job(std::function<void()> f);
   void wait_for_search_finished();
   int best_move_count(Move move) const;
 
@@ -68,6 +78,7 @@ public:
   std::atomic<bool> threadStarted;
 #endif
 
+  ThreadPool& threads; // The pool this thread searches with
   Position rootPos;
   Search::RootMoves rootMoves;
   Depth rootDepth, completedDepth;
@@ -79,6 +90,35 @@ public:
 };
 
 
+/// Timer is a thread that raises the stop of its pool at the deadline of the
+/// search, so that the search does not have to read the clock. While armed, it
+/// also prints the debug counters every second. The wasm build has no thread
+/// to spare for it, so there the search polls the timer instead.
+
+class Timer {
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  ThreadPool& threads;
+  TimePoint deadline, stopTime, lastInfoTime;
+  bool exit = false, armed = false; // Set before starting std::thread
+#ifndef ROYAL_WASM
+  NativeThread stdThread;
+#endif
+
+  bool expired(TimePoint tick);
+
+public:
+  explicit Timer(ThreadPool&);
+  ~Timer();
+  void arm(TimePoint time);
+  TimePoint disarm();
+  void wake();
+  void poll();
+  void idle_loop();
+};
+
+
 /// MainThread is a derived class specific for main thread
 
 struct MainThread : public Thread {
@@ -92,19 +132,26 @@ struct MainThread : public Thread {
   Value bestPreviousScore;
   Value iterValue[4];
   int callsCnt;
-  bool stopOnPonderhit;
+  std::atomic_bool stopOnPonderhit;
   std::atomic_bool ponder;
+  uint64_t effortStops = 0; // Searches stopped early on an easy move
+  Timer timer{threads};
 };
 
 
 /// ThreadPool struct handles all the threads-related stuff like init, starting,
 /// parking and, most importantly, launching a thread. All the access to threads
-/// is done through this class.
+/// is done through this class. A pool searches one position at a time, with its
+/// own limits and time management, so that the sessions of UCI "session" can
+/// each search with a pool of their own besides the global one.
 
 struct ThreadPool : public std::vector<Thread*> {
 
+  ThreadPool() : time(*this), paused(false) {}
+
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
   void clear();
+  void release();
   void set(size_t);
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
@@ -113,11 +160,23 @@ struct ThreadPool : public std::vector<Thread*> {
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
+  void pause();
+  void resume();
+  void wait_while_paused();
 
   std::atomic_bool stop, increaseDepth;
+  Search::LimitsType limits;
+  int reductions[MAX_MOVES] = {}; // [depth or moveNumber], see Search::init()
+  TimeManagement time;
+  std::string tag; // Starts the output lines of the pool, see SyncTag
+  std::function<void()> searchFinished; // Called by the main thread after "bestmove"
 
 private:
+  std::mutex pauseMutex;
+  std::condition_variable pauseCv;
+  std::atomic_bool paused;
   StateListPtr setupStates;
+  std::vector<Thread*> parked;
 
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
@@ -21,12 +21,22 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <iomanip>
+#include <sstream>
 
 #include "search.h"
+#include "thread.h"
 #include "timeman.h"
 #include "uci.h"
 
-TimeManagement Time; // Our global time management object
+
+/// TimeManagement::elapsed() is the time spent on the search, counted in nodes
+/// in 'nodes as time' mode.
+
+TimePoint TimeManagement::elapsed() const {
+
+  return threads.limits.npmsec ? TimePoint(threads.nodes_searched()) : now() - startTime;
+}
 
 
 /// TimeManagement::init() is called at the beginning of the search and calculates
@@ -36,7 +46,7 @@ TimeManagement Time; // Our global time management object
 
 void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
 
-  TimePoint moveOverhead    = TimePoint(Options["Move Overhead"]);
+  TimePoint moveOverhead    = move_overhead();
   TimePoint slowMover       = TimePoint(Options["Slow Mover"]);
   TimePoint npmsec          = TimePoint(Options["nodestime"]);
 
@@ -97,3 +107,103 @@ void TimeManagement::init(Search::LimitsType& limits, Color us, int ply) {
   if (Options["Ponder"])
       optimumTime += optimumTime / 4;
 }
+
+
+/// TimeManagement::move_overhead() is the time reserved per move for the delays
+/// the search does not see. Once enough searches on the clock have been seen,
+/// it is twice the 95th percentile of their measured latencies, between the
+/// "Move Overhead" option and one second.
+
+TimePoint TimeManagement::move_overhead() const {
+
+  TimePoint option = TimePoint(Options["Move Overhead"]);
+  Latencies samples = latency_samples();
+
+  if (samples.size() < 8)
+      return option;
+
+  std::vector<int64_t> total;
+  for (auto& l : samples)
+      total.push_back(l.first + l.second);
+
+  std::sort(total.begin(), total.end());
+
+  TimePoint calibrated = TimePoint(2 * total[total.size() * 95 / 100] / 1000 + 1);
+
+  return std::min(std::max(calibrated, option), std::max(option, TimePoint(1000)));
+}
+
+
+/// TimeManagement::add_latency() records the latencies of a search on the clock:
+/// from the arrival of "go" to the start of the search, including the time the
+/// command waited to be accepted, and from when the search was due to stop
+/// to the flush of "bestmove".
+
+void TimeManagement::add_latency(int64_t commandLatency, int64_t stopLatency) {
+
+  auto sample = std::make_pair(std::max(commandLatency, int64_t(0)),
+                               std::max(stopLatency, int64_t(0)));
+
+  std::lock_guard<std::mutex> lk(latencyMutex);
+
+  if (latencies.size() < LatencySamples)
+      latencies.push_back(sample);
+  else
+      latencies[latencyIdx] = sample;
+
+  latencyIdx = (latencyIdx + 1) % LatencySamples;
+}
+
+
+/// TimeManagement::latency_samples() returns a copy of the recorded latencies
+
+TimeManagement::Latencies TimeManagement::latency_samples() const {
+
+  std::lock_guard<std::mutex> lk(latencyMutex);
+  return latencies;
+}
+
+
+/// TimeManagement::latency_info() returns the distribution of the recorded
+/// latencies and the resulting move overhead, for the "latency" command.
+
+std::string TimeManagement::latency_info() const {
+
+  std::stringstream ss;
+  std::vector<int64_t> series[3];
+  Latencies samples = latency_samples();
+
+  for (auto& l : samples)
+  {
+      series[0].push_back(l.first);
+      series[1].push_back(l.second);
+      series[2].push_back(l.first + l.second);
+  }
+
+  ss << "Latency samples: " << samples.size() << " (last " << LatencySamples << " kept)";
+
+  const char* names[] = { "go to search", "stop to bestmove", "total" };
+
+  for (int i = 0; i < 3 && !samples.empty(); ++i)
+  {
+      auto& v = series[i];
+      std::sort(v.begin(), v.end());
+
+      double mean = 0;
+      for (int64_t x : v)
+          mean += x;
+      mean /= v.size();
+
+      ss << "\n" << std::left << std::setw(17) << names[i] << std::right
+         << " us: min " << v.front()
+         << " mean " << int64_t(mean)
+         << " p50 " << v[v.size() / 2]
+         << " p95 " << v[v.size() * 95 / 100]
+         << " max " << v.back();
+  }
+
+  ss << "\nMove Overhead: " << move_overhead() << " ms (option "
+     << int(Options["Move Overhead"]) << " ms)";
+
+  return ss.str();
+}
@@ -21,29 +21,49 @@
 #ifndef TIMEMAN_H_INCLUDED
 #define TIMEMAN_H_INCLUDED
 
+#include <string>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "misc.h"
 #include "search.h"
-#include "thread.h"
+
+struct ThreadPool;
 
 /// The TimeManagement class computes the optimal time to think depending on
 /// the maximum available time, the game move number and other parameters.
+/// Each thread pool has its own.
 
 class TimeManagement {
 public:
+  explicit TimeManagement(const ThreadPool& pool) : threads(pool) {}
   void init(Search::LimitsType& limits, Color us, int ply);
   TimePoint optimum() const { return optimumTime; }
   TimePoint maximum() const { return maximumTime; }
-  TimePoint elapsed() const { return Search::Limits.npmsec ?
-                                     TimePoint(Threads.nodes_searched()) : now() - startTime; }
+  TimePoint elapsed() const;
+
+  TimePoint move_overhead() const;
+  void add_latency(int64_t commandLatency, int64_t stopLatency);
+  std::string latency_info() const;
 
   int64_t availableNodes; // When in 'nodes as time' mode
 
 private:
+  const ThreadPool& threads;
   TimePoint startTime;
   TimePoint optimumTime;
   TimePoint maximumTime;
-};
 
-extern TimeManagement Time;
+  // The latest latencies of the searches on the clock, in microseconds. They are
+  // added by the main thread after "bestmove" and read by the UCI thread.
+  typedef std::vector<std::pair<int64_t, int64_t>> Latencies;
+  static const size_t LatencySamples = 64;
+  mutable std::mutex latencyMutex;
+  Latencies latencies;
+  size_t latencyIdx = 0;
+
+  Latencies latency_samples() const;
+};
 
 #endif // #ifndef TIMEMAN_H_INCLUDED
@@ -37,6 +37,9 @@
 ///
 /// -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 ///               | only in 64-bit mode and requires hardware with pext support.
+///
+/// -DUSE_PADDED  | Lay out bitboards with 11 bits per rank, the last one being an
+///               | always-empty guard file. East/west shifts then need no file mask.
 
 #include <cassert>
 #include <cctype>
@@ -97,6 +100,16 @@ constexpr bool Is64Bit = true;
 constexpr bool Is64Bit = false;
 #endif
 
+#ifdef USE_PADDED
+constexpr bool IsPadded = true;
+#else
+constexpr bool IsPadded = false;
+#endif
+
+/// Number of bits per rank in a bitboard. The padded layout keeps an extra,
+/// always-empty guard file to the right of file J.
+constexpr int BoardWidth = IsPadded ? 11 : 10;
+
 typedef uint64_t Key;
 //typedef uint64_t Bitboard;
 typedef __uint128_t Bitboard;
@@ -106,8 +119,8 @@ constexpr int MAX_PLY   = 246;
 
 /// A move needs 16 bits to be stored
 ///
-/// bit  0- 6: destination square (from 0 to 63)
-/// bit  7-13: origin square (from 0 to 63)
+/// bit  0- 6: destination square (from SQ_A1 to SQ_J10)
+/// bit  7-13: origin square (from SQ_A1 to SQ_J10)
 /// bit 14-17: promotion piece type
 /// bit 18-19: special move flag: promotion (1), en passant (2), castling (3)
 /// bit    20: promote the princess to a queen
@@ -195,7 +208,7 @@ enum PieceType {
   PIECE_TYPE_NB = 16
 };
 
-enum Piece {
+enum Piece : uint8_t {
   NO_PIECE,
   W_PAWN = 1, W_KNIGHT, W_BISHOP, W_ROOK, W_PRINCESS, W_QUEEN, W_PRINCE, W_KING,
   B_PAWN = 17, B_KNIGHT, B_BISHOP, B_ROOK, B_PRINCESS, B_QUEEN, B_PRINCE, B_KING,
@@ -224,22 +237,22 @@ enum : int {
 
 enum Square : int {
   SQ_A1, SQ_B1, SQ_C1, SQ_D1, SQ_E1, SQ_F1, SQ_G1, SQ_H1, SQ_I1, SQ_J1,
-  SQ_A2, SQ_B2, SQ_C2, SQ_D2, SQ_E2, SQ_F2, SQ_G2, SQ_H2, SQ_I2, SQ_J2,
-  SQ_A3, SQ_B3, SQ_C3, SQ_D3, SQ_E3, SQ_F3, SQ_G3, SQ_H3, SQ_I3, SQ_J3,
-  SQ_A4, SQ_B4, SQ_C4, SQ_D4, SQ_E4, SQ_F4, SQ_G4, SQ_H4, SQ_I4, SQ_J4,
-  SQ_A5, SQ_B5, SQ_C5, SQ_D5, SQ_E5, SQ_F5, SQ_G5, SQ_H5, SQ_I5, SQ_J5,
-  SQ_A6, SQ_B6, SQ_C6, SQ_D6, SQ_E6, SQ_F6, SQ_G6, SQ_H6, SQ_I6, SQ_J6,
-  SQ_A7, SQ_B7, SQ_C7, SQ_D7, SQ_E7, SQ_F7, SQ_G7, SQ_H7, SQ_I7, SQ_J7,
-  SQ_A8, SQ_B8, SQ_C8, SQ_D8, SQ_E8, SQ_F8, SQ_G8, SQ_H8, SQ_I8, SQ_J8,
-  SQ_A9, SQ_B9, SQ_C9, SQ_D9, SQ_E9, SQ_F9, SQ_G9, SQ_H9, SQ_I9, SQ_J9,
-  SQ_A10, SQ_B10, SQ_C10, SQ_D10, SQ_E10, SQ_F10, SQ_G10, SQ_H10, SQ_I10, SQ_J10,
-  SQ_NONE,
-
-  SQUARE_NB = 100
+  SQ_A2 = 1 * BoardWidth, SQ_B2, SQ_C2, SQ_D2, SQ_E2, SQ_F2, SQ_G2, SQ_H2, SQ_I2, SQ_J2,
+  SQ_A3 = 2 * BoardWidth, SQ_B3, SQ_C3, SQ_D3, SQ_E3, SQ_F3, SQ_G3, SQ_H3, SQ_I3, SQ_J3,
+  SQ_A4 = 3 * BoardWidth, SQ_B4, SQ_C4, SQ_D4, SQ_E4, SQ_F4, SQ_G4, SQ_H4, SQ_I4, SQ_J4,
+  SQ_A5 = 4 * BoardWidth, SQ_B5, SQ_C5, SQ_D5, SQ_E5, SQ_F5, SQ_G5, SQ_H5, SQ_I5, SQ_J5,
+  SQ_A6 = 5 * BoardWidth, SQ_B6, SQ_C6, SQ_D6, SQ_E6, SQ_F6, SQ_G6, SQ_H6, SQ_I6, SQ_J6,
+  SQ_A7 = 6 * BoardWidth, SQ_B7, SQ_C7, SQ_D7, SQ_E7, SQ_F7, SQ_G7, SQ_H7, SQ_I7, SQ_J7,
+  SQ_A8 = 7 * BoardWidth, SQ_B8, SQ_C8, SQ_D8, SQ_E8, SQ_F8, SQ_G8, SQ_H8, SQ_I8, SQ_J8,
+  SQ_A9 = 8 * BoardWidth, SQ_B9, SQ_C9, SQ_D9, SQ_E9, SQ_F9, SQ_G9, SQ_H9, SQ_I9, SQ_J9,
+  SQ_A10 = 9 * BoardWidth, SQ_B10, SQ_C10, SQ_D10, SQ_E10, SQ_F10, SQ_G10, SQ_H10, SQ_I10, SQ_J10,
+  SQ_NONE = 10 * BoardWidth,
+
+  SQUARE_NB = SQ_NONE
 };
 
 enum Direction : int {
-  NORTH =  10,
+  NORTH = BoardWidth,
   EAST  =  1,
   SOUTH = -NORTH,
   WEST  = -EAST,
@@ -353,8 +366,7 @@ constexpr Color operator~(Color c) {
 }
 
 constexpr Square make_square(File f, Rank r) {
-  //return Square((r << 3) + f);
-  return Square(r * 10 + f);
+  return Square(r * BoardWidth + f);
 }
 
 constexpr Piece make_piece(Color c, PieceType pt) {
@@ -362,11 +374,11 @@ constexpr Piece make_piece(Color c, PieceType pt) {
 }
 
 constexpr File file_of(Square s) {
-  return File(s % 10);
+  return File(s % BoardWidth);
 }
 
 constexpr Rank rank_of(Square s) {
-  return Rank(s / 10);
+  return Rank(s / BoardWidth);
 }
 
 constexpr Square flip_rank(Square s) {
@@ -403,7 +415,7 @@ inline Color color_of(Piece pc) {
 }
 
 constexpr bool is_ok(Square s) {
-  return s >= SQ_A1 && s <= SQ_J10;
+  return s >= SQ_A1 && s <= SQ_J10 && (!IsPadded || file_of(s) != FILE_NB);
 }
 
 constexpr Square relative_square(Color c, Square s) {
@@ -435,7 +447,7 @@ constexpr Square to_sq(Move m) {
 }
 
 constexpr int from_to(Move m) {
- return m & 0x3FFF;
+  return from_sq(m) * SQUARE_NB + to_sq(m);
 }
 
 constexpr MoveType type_of(Move m) {
@@ -18,10 +18,18 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #ifdef ROYAL_WASM
 #include <emscripten.h>
@@ -39,6 +47,11 @@
 using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern vector<string> setup_perft_suite(istream&);
+extern void microbench(istream&);
+
+void handle_command(string& token, const string& cmd, StateListPtr& states,
+                    Position& pos, int64_t received, ThreadPool& threads = Threads);
 
 namespace {
 
@@ -53,7 +66,7 @@ namespace {
   // or the starting position ("startpos") and then makes the moves given in the
   // following move list ("moves").
 
-  void position(Position& pos, istringstream& is, StateListPtr& states) {
+  void position(Position& pos, istringstream& is, StateListPtr& states, ThreadPool& threads = Threads) {
 
     Move m;
     string token, fen;
@@ -72,7 +85,7 @@ namespace {
         return;
 
     states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
-    pos.set(fen, &states->back(), Threads.main());
+    pos.set(fen, &states->back(), threads.main());
 
     // Parse move list (if any)
     while (is >> token)
@@ -114,18 +127,33 @@ namespace {
   }
 
 
+  // clear_search() resets the histories of a pool, before a new game or a perft.
+  // The global pool also clears the perft hash, shared by the whole process.
+
+  void clear_search(ThreadPool& threads) {
+
+    if (&threads == &Threads)
+        Search::clear();
+    else
+        threads.clear();
+  }
+
+
   // go() is called when engine receives the "go" UCI command. The function sets
   // the thinking time and other parameters from the input string, then starts
-  // the search.
+  // the search. The time a session waited for its threads, in microseconds, is
+  // counted in the search time.
 
-  void go(Position& pos, istringstream& is, StateListPtr& states) {
+  void go(Position& pos, istringstream& is, StateListPtr& states, int64_t received = 0,
+          ThreadPool& threads = Threads, int64_t queued = 0) {
 
     Search::LimitsType limits;
     string token;
     bool ponderMode = false;
 
-    Search::clear();
-    limits.startTime = now(); // As early as possible!
+    limits.startTime = now() - queued / 1000; // As early as possible!
+    limits.commandLatency = received ? now_micros() - received - queued : 0;
+    limits.effortStop = Options["Effort Stop"];
 
     while (is >> token)
         if (token == "searchmoves") // Needs to be the last command on the line
@@ -145,7 +173,13 @@ namespace {
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
-    Threads.start_thinking(pos, states, limits, ponderMode);
+    // The perft hash is only reset for a perft, not to slow down every search
+    if (limits.perft)
+        clear_search(threads);
+    else
+        threads.clear();
+
+    threads.start_thinking(pos, states, limits, ponderMode);
   }
 
 
@@ -153,11 +187,24 @@ namespace {
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
 
+  void bench_scaling(Position& pos, istream& args, StateListPtr& states);
+
   void bench(Position& pos, istream& args, StateListPtr& states) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
 
+    auto start = args.tellg();
+
+    if (args >> token && token == "scaling")
+    {
+        bench_scaling(pos, args, states);
+        return;
+    }
+
+    args.clear();
+    args.seekg(start);
+
     vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
 
@@ -195,6 +242,1135 @@ namespace {
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
   }
 
+
+  // Statistics of the repeated runs of one thread count: the mean and the half
+  // width of its 95% confidence interval, in the normal approximation.
+
+  struct Estimate {
+
+    Estimate(const vector<double>& samples) {
+      for (double x : samples)
+          mean += x / samples.size();
+
+      double var = 0;
+      for (double x : samples)
+          var += (x - mean) * (x - mean) / std::max(samples.size() - 1, size_t(1));
+
+      ci = 1.96 * std::sqrt(var / samples.size());
+    }
+
+    double mean = 0, ci = 0;
+  };
+
+
+  // bench_scaling() is called when engine receives the "bench scaling" command.
+  // It searches the bench positions to a fixed depth with 1, 2, 4... threads up
+  // to the given maximum, each thread count several times from cleared histories,
+  // and reports the time to depth, the speed, the speedup and efficiency over a
+  // single thread, and the share of the nodes searched by each thread. The first
+  // argument is the hash size of bench, unused here, so that both commands take
+  // their arguments in the same order.
+  //
+  // bench scaling -> up to all the cores, depth 13, 3 runs
+  // bench scaling 16 8 16 default 5 -> up to 8 threads, depth 16, 5 runs
+
+  void bench_scaling(Position& pos, istream& args, StateListPtr& states) {
+
+    string token;
+
+    string ttSize  = (args >> token) ? token : "16";
+    int maxThreads = (args >> token) ? stoi(token) : int(std::thread::hardware_concurrency());
+    string depth   = (args >> token) ? token : "13";
+    string fenFile = (args >> token) ? token : "default";
+    int runs       = (args >> token) ? std::max(stoi(token), 1) : 3;
+
+    vector<size_t> counts;
+    for (int n = 1; n < maxThreads; n *= 2)
+        counts.push_back(n);
+    counts.push_back(std::max(maxThreads, 1));
+
+    vector<vector<double>> times(counts.size()), speeds(counts.size());
+    vector<vector<uint64_t>> threadNodes(counts.size());
+
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        istringstream ss(ttSize + " " + to_string(counts[c]) + " " + depth + " " + fenFile + " depth");
+        vector<string> list = setup_bench(pos, ss);
+
+        threadNodes[c].assign(counts[c], 0);
+
+        for (int r = 0; r < runs; ++r)
+        {
+            TimePoint elapsed = 0;
+            uint64_t nodes = 0;
+
+            for (const auto& cmd : list)
+            {
+                istringstream is(cmd);
+                is >> skipws >> token;
+
+                if (token == "go")
+                {
+                    TimePoint start = now();
+                    go(pos, is, states);
+                    Threads.main()->wait_for_search_finished();
+                    elapsed += now() - start;
+
+                    for (size_t i = 0; i < Threads.size(); ++i)
+                        threadNodes[c][i] += Threads[i]->nodes;
+
+                    nodes += Threads.nodes_searched();
+                }
+                else if (token == "setoption")  setoption(is);
+                else if (token == "position")   position(pos, is, states);
+                else if (token == "ucinewgame") Search::clear();
+            }
+
+            elapsed += 1; // Ensure positivity to avoid a 'divide by zero'
+
+            times[c].push_back(double(elapsed));
+            speeds[c].push_back(1000.0 * nodes / elapsed);
+
+            cerr << "\nThreads " << counts[c] << " run " << r + 1 << '/' << runs
+                 << ": " << elapsed << " ms, " << nodes << " nodes" << endl;
+        }
+    }
+
+    Estimate base(times[0]);
+    ios::fmtflags flags = cerr.flags();
+    streamsize precision = cerr.precision();
+
+    cerr << "\n==========================="
+         << "\nDepth " << depth << ", " << runs << " runs per thread count, 95% intervals"
+         << "\nThreads   Time to depth (ms)        Nodes/second       Speedup   Efficiency"
+         << fixed << endl;
+
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        Estimate time(times[c]), speed(speeds[c]);
+
+        double speedup = base.mean / time.mean;
+        double error = speedup * std::sqrt(  (base.ci / base.mean) * (base.ci / base.mean)
+                                           + (time.ci / time.mean) * (time.ci / time.mean));
+
+        cerr << setw(7) << counts[c]
+             << setprecision(0) << setw(12) << time.mean  << " +- " << setw(6) << time.ci
+             << setw(12) << speed.mean << " +- " << setw(8) << speed.ci
+             << setprecision(2) << setw(8) << speedup << " +- " << setw(4) << error
+             << setprecision(1) << setw(8) << 100 * speedup / counts[c] << '%' << endl;
+    }
+
+    cerr << "\nNodes per thread (%)" << endl;
+
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        uint64_t total = 0;
+        for (uint64_t n : threadNodes[c])
+            total += n;
+
+        cerr << setw(7) << counts[c] << " ";
+        for (uint64_t n : threadNodes[c])
+            cerr << " " << setprecision(1) << 100.0 * n / std::max(total, uint64_t(1));
+        cerr << endl;
+    }
+
+    cerr.flags(flags);
+    cerr.precision(precision);
+  }
+
+
+  // generated_moves() returns the moves of generate<LEGAL>, sorted and each
+  // one once, while the list itself holds the princess promotion variants as
+  // many times as perft counts them.
+
+  vector<Move> generated_moves(const Position& pos) {
+
+    vector<Move> moves;
+
+    for (const auto& m : MoveList<LEGAL>(pos))
+        moves.push_back(m);
+
+    sort(moves.begin(), moves.end());
+    moves.erase(unique(moves.begin(), moves.end()), moves.end());
+    return moves;
+  }
+
+
+  // tested_moves() finds the legal moves without the move generators, trying
+  // every move encoding from each of our pieces with pseudo_legal() and legal().
+
+  vector<Move> tested_moves(const Position& pos) {
+
+    vector<Move> moves;
+    Bitboard ours = pos.pieces(pos.side_to_move());
+
+    while (ours)
+    {
+        Square from = pop_lsb(&ours);
+        Bitboard targets = AllSquares & ~square_bb(from);
+
+        while (targets)
+        {
+            Square to = pop_lsb(&targets);
+
+            for (bool princess : { false, true })
+                for (Move m : { make_move(from, to, princess),
+                                make<ENPASSANT>(from, to, KNIGHT, princess),
+                                make<CASTLING >(from, to, KNIGHT, princess),
+                                make<PROMOTION>(from, to, KNIGHT, princess),
+                                make<PROMOTION>(from, to, BISHOP, princess),
+                                make<PROMOTION>(from, to, ROOK,   princess),
+                                make<PROMOTION>(from, to, QUEEN,  princess) })
+                    if (pos.pseudo_legal(m) && pos.legal(m))
+                        moves.push_back(m);
+        }
+    }
+
+    sort(moves.begin(), moves.end());
+    return moves;
+  }
+
+
+  // check_move_list() compares the generated moves of a position with the
+  // tested ones, and prints the differences. Returns true if there are none.
+
+  bool check_move_list(const Position& pos, const string& path) {
+
+    vector<Move> generated = generated_moves(pos), tested = tested_moves(pos);
+    vector<Move> extra, missing;
+
+    if (generated == tested)
+        return true;
+
+    set_difference(generated.begin(), generated.end(), tested.begin(), tested.end(), back_inserter(extra));
+    set_difference(tested.begin(), tested.end(), generated.begin(), generated.end(), back_inserter(missing));
+
+    sync_cout << "  move list differs after" << (path.empty() ? " the root" : path)
+              << "\n  fen " << pos.fen()
+              << "\n  generated, not legal:";
+
+    for (Move m : extra)
+        cout << " " << UCI::move(m);
+
+    cout << "\n  legal, not generated:";
+
+    for (Move m : missing)
+        cout << " " << UCI::move(m);
+
+    cout << sync_endl;
+    return false;
+  }
+
+
+  // find_move_list_error() walks the perft tree in move order until a node
+  // fails check_move_list(), visiting at most 'budget' nodes.
+
+  bool find_move_list_error(Position& pos, Depth depth, string& path, int& budget) {
+
+    if (budget-- <= 0)
+        return false;
+
+    if (!check_move_list(pos, path))
+        return true;
+
+    if (depth <= 1)
+        return false;
+
+    StateInfo st;
+    size_t len = path.size();
+
+    for (Move m : generated_moves(pos))
+    {
+        path += " " + UCI::move(m);
+        pos.do_move(m, st);
+        bool found = find_move_list_error(pos, depth - 1, path, budget);
+        pos.undo_move(m);
+
+        if (found)
+            return true;
+
+        path.resize(len);
+    }
+
+    return false;
+  }
+
+
+  // perft_divide_down() follows a failing perft suite entry down the moves
+  // where the hashed and bulk counting perft() disagrees with the plain
+  // perft_reference(), and prints the sequence where the counts first go wrong.
+  // If both agree at the root, the fault is shared by them and so lies in the
+  // move lists, which are then checked node by node against the tested moves.
+
+  void perft_divide_down(Position& pos, Depth depth) {
+
+    std::deque<StateInfo> states;
+    vector<Move> line;
+    string path;
+
+    while (depth >= 2)
+    {
+        Move bad = MOVE_NONE;
+        uint64_t fast = 0, slow = 0;
+
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            states.emplace_back();
+            pos.do_move(m, states.back());
+
+            fast = Search::perft(pos, depth - 1);
+            slow = Search::perft_reference(pos, depth - 1);
+
+            if (fast != slow)
+            {
+                bad = m;
+                break;
+            }
+
+            pos.undo_move(m);
+            states.pop_back();
+        }
+
+        if (!bad)
+            break;
+
+        line.push_back(bad);
+        path += " " + UCI::move(bad);
+        --depth;
+
+        sync_cout << "  after" << path << ": perft " << fast
+                  << ", reference " << slow << sync_endl;
+    }
+
+    if (!line.empty())
+        check_move_list(pos, path);
+    else
+    {
+        int budget = 100000;
+
+        sync_cout << "  perft and reference agree, checking the move lists" << sync_endl;
+
+        if (!find_move_list_error(pos, depth, path, budget))
+            sync_cout << "  no move list error found, check the expected count" << sync_endl;
+    }
+
+    while (!line.empty())
+    {
+        pos.undo_move(line.back());
+        line.pop_back();
+    }
+  }
+
+
+  // selfplay() is called when engine receives the "selfplay" command. It plays
+  // games of the engine against itself on a clock, each bench position twice
+  // with the colours swapped, where only one side may stop its searches early
+  // on effort. It reports the score of that side, how often it stopped early,
+  // and the time per move of both.
+  //
+  // selfplay -> 10 games of 10+0.1 seconds
+  // selfplay 20 60000 500 -> 20 games of 60+0.5 seconds
+
+  void selfplay(Position& pos, istream& args, StateListPtr& states) {
+
+    string token;
+
+    int games      = (args >> token) ? stoi(token) : 10;
+    TimePoint time = (args >> token) ? stoll(token) : 10000;
+    TimePoint inc  = (args >> token) ? stoll(token) : 100;
+    string fenFile = (args >> token) ? token : "default";
+
+    vector<string> fens;
+    istringstream ss("16 1 1 " + fenFile);
+
+    for (const auto& cmd : setup_bench(pos, ss))
+        if (cmd.find("position ") == 0)
+            fens.push_back(cmd.substr(9));
+
+    int wins = 0, draws = 0, losses = 0, timeLosses = 0, earlyStops = 0;
+    TimePoint spent[2] = {}; // Indexed by whether the side stops on effort
+    int plies[2] = {};
+
+    for (int g = 0; g < games && !fens.empty(); ++g)
+    {
+        const string& fen = fens[(g / 2) % fens.size()];
+        Color effortSide = g % 2 ? BLACK : WHITE;
+        TimePoint clock[COLOR_NB] = { time, time };
+        string moves, end = "draw";
+        int result = 0; // From the effort side point of view
+        int ply = 0;
+
+        for ( ; ; ++ply)
+        {
+            istringstream is(fen + " moves" + moves);
+            position(pos, is, states);
+
+            Color us = pos.side_to_move();
+            int sign = us == effortSide ? 1 : -1;
+
+            if (!MoveList<LEGAL>(pos).size())
+            {
+                if (pos.checkers() || pos.king_capturers())
+                    result = -sign, end = "mate";
+                break;
+            }
+
+            if (pos.is_draw(ply) || ply >= 400)
+                break;
+
+            Search::LimitsType limits;
+            limits.startTime = now();
+            Threads.clear(); // As go() does
+            limits.time[WHITE] = clock[WHITE];
+            limits.time[BLACK] = clock[BLACK];
+            limits.inc[WHITE] = limits.inc[BLACK] = inc;
+            limits.effortStop = us == effortSide;
+
+            uint64_t effortStops = Threads.main()->effortStops;
+
+            Threads.start_thinking(pos, states, limits);
+            Threads.main()->wait_for_search_finished();
+
+            earlyStops += int(Threads.main()->effortStops - effortStops);
+
+            TimePoint used = now() - limits.startTime;
+            spent[us == effortSide] += used;
+            plies[us == effortSide]++;
+
+            if ((clock[us] -= used) < 0)
+            {
+                result = -sign, end = "time";
+                timeLosses++;
+                break;
+            }
+
+            clock[us] += inc;
+            moves += " " + UCI::move(Threads.get_best_thread()->rootMoves[0].pv[0]);
+        }
+
+        result > 0 ? wins++ : result < 0 ? losses++ : draws++;
+
+        cerr << "\nGame " << g + 1 << '/' << games << ": effort stop plays "
+             << (effortSide == WHITE ? "white" : "black") << ", "
+             << (result > 0 ? "wins" : result < 0 ? "loses" : "draws")
+             << " (" << end << ") after " << ply << " plies" << endl;
+    }
+
+    cerr << "\n==========================="
+         << "\nGames           : " << wins + draws + losses
+         << "\nEffort stop     : +" << wins << " =" << draws << " -" << losses
+         << "\nScore           : " << 100.0 * (wins + draws / 2.0) / std::max(wins + draws + losses, 1) << '%'
+         << "\nLosses on time  : " << timeLosses
+         << "\nEarly stops     : " << earlyStops << " of " << plies[1] << " moves"
+         << "\nTime per move   : " << spent[1] / std::max(plies[1], 1) << " ms with effort stop, "
+                                   << spent[0] / std::max(plies[0], 1) << " ms without" << endl;
+  }
+
+
+  // batch() is called when engine receives the "batch" command. It searches the
+  // positions of a file to a fixed depth, each one on a single thread with its
+  // own histories, so that as many positions as threads are searched at once.
+  // Each search is the one of 'go depth' with a single thread. The results are
+  // printed as they come, tagged with the position number.
+  //
+  // batch -> the bench positions to depth 10
+  // batch 14 positions.fen -> the positions of the file to depth 14
+
+  void batch(Position& pos, istream& args) {
+
+    string token;
+
+    Depth depth    = (args >> token) ? stoi(token) : 10;
+    string fenFile = (args >> token) ? token : "default";
+
+    vector<string> fens;
+    istringstream ss("16 1 1 " + fenFile);
+
+    for (const auto& cmd : setup_bench(pos, ss))
+        if (cmd.find("position fen ") == 0)
+            fens.push_back(cmd.substr(13));
+
+    Threads.main()->wait_for_search_finished();
+
+    Search::LimitsType limits;
+    limits.depth = depth;
+    limits.batch = true;
+    limits.startTime = now();
+
+    Threads.limits = limits;
+    Search::init(Threads);
+    Threads.main()->stopOnPonderhit = Threads.main()->ponder = Threads.stop = false;
+    Threads.increaseDepth = true;
+
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> nodes(0);
+
+    for (Thread* th : Threads)
+        th->run_job([th, &fens, &next, &nodes]() {
+
+            for (size_t n; (n = next++) < fens.size(); )
+            {
+                StateInfo st;
+                th->clear(); // As go() does
+                th->rootPos.set(fens[n], &st, th);
+                th->rootMoves.clear();
+
+                for (const auto& m : MoveList<LEGAL>(th->rootPos))
+                    th->rootMoves.emplace_back(m);
+
+                th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
+                th->rootDepth = th->completedDepth = 0;
+
+                Move best = MOVE_NONE;
+                Value v = th->rootPos.checkers() || th->rootPos.king_capturers() ? -VALUE_MATE : VALUE_DRAW;
+
+                if (!th->rootMoves.empty())
+                {
+                    th->Thread::search(); // Also on the main thread, not to time or print it
+                    best = th->rootMoves[0].pv[0];
+                    v = th->rootMoves[0].score;
+                }
+
+                nodes += th->nodes;
+
+                sync_cout << "batch " << n + 1
+                          << " bestmove " << UCI::move(best)
+                          << " score " << UCI::value(v)
+                          << " depth " << th->completedDepth
+                          << " nodes " << th->nodes << sync_endl;
+            }
+        });
+
+    for (Thread* th : Threads)
+        th->wait_for_search_finished();
+
+    TimePoint elapsed = now() - limits.startTime + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    cerr << "\n==========================="
+         << "\nPositions       : " << fens.size()
+         << "\nThreads         : " << Threads.size()
+         << "\nTotal time (ms) : " << elapsed
+         << "\nNodes searched  : " << nodes
+         << "\nNodes/second    : " << 1000 * nodes / elapsed
+         << "\nPositions/second: " << 1000.0 * fens.size() / elapsed << endl;
+  }
+
+
+  // perft_suite() is called when engine receives the "perftsuite" command. It
+  // runs perft with all the threads on every entry of a suite and checks the
+  // counts, printing the speed of each one. Failing entries are divided down,
+  // and the entries without an expected count are printed in suite format.
+
+  void perft_suite(Position& pos, istream& args, StateListPtr& states) {
+
+    uint64_t nodes = 0;
+    int cnt = 0, failed = 0;
+
+    vector<string> list = setup_perft_suite(args);
+
+    TimePoint elapsed = now();
+
+    for (const auto& entry : list)
+    {
+        istringstream ss(entry);
+        string fen, field;
+        Depth depth = 0;
+        uint64_t expected = 0;
+
+        getline(ss, fen, ';');
+
+        if (getline(ss, field, ';'))
+            istringstream(field) >> depth;
+
+        if (getline(ss, field, ';'))
+            istringstream(field) >> expected;
+
+        if (depth < 1)
+        {
+            sync_cout << "Invalid perft suite entry: " << entry << sync_endl;
+            continue;
+        }
+
+        istringstream is("fen " + fen);
+        position(pos, is, states);
+
+        Search::LimitsType limits;
+        limits.perft = depth;
+        limits.silent = true;
+        limits.startTime = now();
+
+        Threads.start_thinking(pos, states, limits);
+        Threads.main()->wait_for_search_finished();
+
+        TimePoint time = now() - limits.startTime + 1;
+        uint64_t n = Threads.nodes_searched();
+        nodes += n;
+        ++cnt;
+
+        fen.erase(fen.find_last_not_of(' ') + 1);
+
+        if (!expected)
+        {
+            sync_cout << fen << " ; " << depth << " ; " << n << sync_endl;
+            continue;
+        }
+
+        sync_cout << (n == expected ? "ok   " : "FAIL ") << cnt << '/' << list.size()
+                  << " depth " << depth << " nodes " << n;
+
+        if (n != expected)
+            cout << " expected " << expected;
+
+        cout << " nps " << 1000 * n / time << " " << fen << sync_endl;
+
+        if (n != expected)
+        {
+            ++failed;
+            perft_divide_down(pos, depth);
+        }
+    }
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    cerr << "\n==========================="
+         << "\nEntries         : " << cnt
+         << "\nFailed          : " << failed
+         << "\nTotal time (ms) : " << elapsed
+         << "\nNodes searched  : " << nodes
+         << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+  }
+
+
+  // A Session is a game of its own played by the process, with its position and
+  // its pool of threads. All the sessions share the tables of the process. The
+  // scheduler decides when their searches run, and with how many threads.
+
+  enum Priority { ANALYSIS, HINT, GAME, PRIORITY_NB };
+
+  const char* PriorityNames[PRIORITY_NB] = { "analysis", "hint", "game" };
+
+  const TimePoint NoDeadline = std::numeric_limits<TimePoint>::max();
+
+  struct Session {
+
+    enum State { IDLE, RUNNING, PAUSED };
+
+    ~Session() { threads.stop = true; threads.resume(); threads.set(0); }
+
+    ThreadPool threads;
+    StateListPtr states;
+    Position pos;
+
+    // Owned by the scheduler, under its lock
+    Priority priority = GAME;
+    size_t wanted = 1; // Threads asked with "session <id> threads"
+    State state = IDLE;
+    bool waiting = false;  // A "go" waits for its threads
+    bool stopping = false; // A "stop" came before the search started
+    string go;
+    int64_t received = 0;  // When the "go" arrived, for its latency
+    int64_t submitted = 0; // When the "go" was queued, for its wait
+    TimePoint deadline = NoDeadline; // When the clock of the search runs out
+    size_t granted = 0;
+  };
+
+  std::map<string, std::unique_ptr<Session>> Sessions;
+
+
+  // Scheduler shares the "Session Threads" between the searches of the sessions,
+  // or lets them all run at once when the option is zero. Waiting searches start
+  // by priority, then by the earliest flag fall, then in order of arrival. When
+  // a search does not fit, the searches of lower priority without a clock are
+  // paused: they stop at their next iteration, and resume when enough threads
+  // are free again. The searches are started from the scheduler thread, so that
+  // a search ending never has to start another one.
+  //
+  // A search is paused and resumed as a whole. So pausing one with several
+  // threads may free more threads than the new search needs, and a paused
+  // search waits until all of its threads are free. Until then some cores of
+  // the budget may stay idle.
+
+  class Scheduler {
+
+    struct Stats { uint64_t searches, preempted; int64_t waitSum, waitMax; };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Session*> active; // Waiting, running or paused
+    std::vector<Session*> resident; // Holding their tables, least recent search first
+    Session* starting = nullptr;
+    Stats stats[PRIORITY_NB] = {};
+    bool exit = false, update = false; // Set before starting std::thread
+    NativeThread stdThread;
+
+    void idle_loop();
+    Session* schedule(size_t& granted);
+    void keep_resident(Session& s, size_t granted);
+
+  public:
+    Scheduler() : stdThread(&Scheduler::idle_loop, this) {}
+    ~Scheduler();
+    void submit(Session& s, const string& cmd, int64_t received);
+    void stop(Session& s);
+    void set_threads(Session& s, size_t n);
+    void set_priority(Session& s, Priority p);
+    void finished(Session& s);
+    void close(Session& s);
+    bool busy(Session& s);
+    string info();
+  };
+
+  std::unique_ptr<Scheduler> SessionScheduler;
+
+
+  Scheduler::~Scheduler() {
+
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        exit = true;
+    }
+
+    cv.notify_all();
+    stdThread.join();
+  }
+
+
+  // Scheduler::idle_loop() starts the searches chosen by schedule(), one at a
+  // time and outside the lock, as a start waits for the previous search of the
+  // session to be over and clears the histories.
+
+  void Scheduler::idle_loop() {
+
+    std::unique_lock<std::mutex> lk(mutex);
+
+    while (true)
+    {
+        cv.wait(lk, [&]{ return update || exit; });
+
+        if (exit)
+            return;
+
+        update = false;
+
+        size_t n;
+        Session* s = schedule(n);
+
+        if (!s)
+            continue;
+
+        keep_resident(*s, n);
+
+        string cmd = s->go;
+        int64_t received = s->received, submitted = s->submitted;
+        starting = s;
+        update = true; // Look for more searches to start
+        lk.unlock();
+
+        istringstream is(cmd);
+        string token;
+        is >> token; // Consume "go" token
+
+        s->threads.set(n); // The main thread, and so pos, is kept
+
+        int64_t queued = now_micros() - submitted;
+
+        SyncTag = s->threads.tag;
+
+        if (queued >= 1000)
+            sync_cout << "info string queued " << queued / 1000 << " ms" << sync_endl;
+
+        go(s->pos, is, s->states, received, s->threads, queued);
+        SyncTag.clear();
+
+        lk.lock();
+
+        Stats& st = stats[s->priority];
+        st.searches++;
+        st.waitSum += queued;
+        st.waitMax = std::max(st.waitMax, queued);
+
+        if (s->stopping)
+            s->threads.stop = true;
+
+        s->stopping = false;
+        starting = nullptr;
+        cv.notify_all();
+    }
+  }
+
+
+  // Scheduler::schedule() pauses and resumes searches so that the waiting ones
+  // run in order, and returns the next one to start with its number of threads.
+
+  Session* Scheduler::schedule(size_t& granted) {
+
+    size_t budget = size_t(Options["Session Threads"]), busy = 0;
+    std::vector<Session*> pending;
+
+    for (Session* s : active)
+        if (s->state == Session::RUNNING)
+            busy += s->granted;
+        else if (s->state == Session::PAUSED || s->waiting)
+            pending.push_back(s);
+
+    std::stable_sort(pending.begin(), pending.end(), [](const Session* a, const Session* b) {
+        return   a->priority != b->priority ? a->priority > b->priority
+               : a->deadline != b->deadline ? a->deadline < b->deadline
+                                            : a->received < b->received;
+    });
+
+    for (Session* s : pending)
+    {
+        // A search stopped before it started must answer at once
+        if (s->stopping && s->state == Session::IDLE)
+        {
+            s->state = Session::RUNNING;
+            s->waiting = false;
+            return granted = s->granted = 1, s;
+        }
+
+        size_t need = s->state == Session::PAUSED ? s->granted : 1;
+
+        // Pause the searches of lower priority without a clock, the lowest first
+        while (budget && busy + need > budget)
+        {
+            Session* victim = nullptr;
+
+            for (Session* r : active)
+                if (   r->state == Session::RUNNING
+                    && r->priority < s->priority
+                    && r->deadline == NoDeadline
+                    && (!victim || r->priority < victim->priority))
+                    victim = r;
+
+            if (!victim)
+                break;
+
+            victim->threads.pause();
+            victim->state = Session::PAUSED;
+            busy -= victim->granted;
+            stats[victim->priority].preempted++;
+        }
+
+        if (budget && busy + need > budget)
+            break; // The searches behind it wait as well
+
+        if (s->state == Session::PAUSED)
+        {
+            s->threads.resume();
+            s->state = Session::RUNNING;
+            busy += s->granted;
+            continue;
+        }
+
+        s->state = Session::RUNNING;
+        s->waiting = false;
+        return granted = s->granted = budget ? std::min(s->wanted, budget - busy) : s->wanted, s;
+    }
+
+    return nullptr;
+  }
+
+
+  // Scheduler::keep_resident() is called when a search starts. The tables of a
+  // thread take about 100MB, and go clears them before every search anyway, so
+  // the idle sessions searched least recently give theirs back, until the
+  // sessions hold at most one table per thread of the budget, or per core when
+  // there is no budget. A session that searches again then pays for the page
+  // faults, about 13ms per thread on a 1-CPU VM.
+
+  void Scheduler::keep_resident(Session& s, size_t granted) {
+
+    size_t budget = size_t(Options["Session Threads"]);
+    size_t cap = std::max(budget ? budget : size_t(std::thread::hardware_concurrency()), size_t(1));
+    size_t total = granted;
+
+    resident.erase(std::remove(resident.begin(), resident.end(), &s), resident.end());
+
+    for (Session* r : resident)
+        total += r->threads.size();
+
+    for (auto it = resident.begin(); total > cap && it != resident.end(); )
+        if ((*it)->state == Session::IDLE && !(*it)->waiting)
+        {
+            total -= (*it)->threads.size();
+            (*it)->threads.release();
+            it = resident.erase(it);
+        }
+        else
+            ++it;
+
+    resident.push_back(&s);
+  }
+
+
+  // Scheduler::submit() queues the "go" of a session. Its deadline is when its
+  // clock runs out, counted from the arrival of the command.
+
+  void Scheduler::submit(Session& s, const string& cmd, int64_t received) {
+
+    TimePoint deadline = NoDeadline, t;
+    string token;
+    istringstream is(cmd);
+
+    while (is >> token)
+        if (   token == "movetime"
+            || token == (s.pos.side_to_move() == WHITE ? "wtime" : "btime"))
+        {
+            if (is >> t)
+                deadline = std::min(deadline, received / 1000 + t);
+        }
+        else if (token == "perft") // The perft tables are shared by the whole process
+        {
+            sync_cout << "No perft in a session" << sync_endl;
+            return;
+        }
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    s.go = cmd;
+    s.received = received;
+    s.submitted = now_micros();
+    s.deadline = deadline;
+    s.waiting = true;
+
+    if (std::find(active.begin(), active.end(), &s) == active.end())
+        active.push_back(&s);
+
+    update = true;
+    cv.notify_all();
+  }
+
+
+  // Scheduler::stop() stops the search of a session, paused or not. A waiting
+  // search is started at once, to answer with a move.
+
+  void Scheduler::stop(Session& s) {
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    s.threads.stop = true;
+
+    if (s.state == Session::PAUSED)
+    {
+        s.state = Session::RUNNING;
+        s.threads.resume();
+    }
+
+    if (s.waiting || starting == &s)
+        s.stopping = true;
+
+    update = true;
+    cv.notify_all();
+  }
+
+
+  // Scheduler::set_threads() and Scheduler::set_priority() change the threads
+  // asked by a session and its priority, which apply from its next search.
+  // The queue is ordered again, as a waiting search may now come first.
+
+  void Scheduler::set_threads(Session& s, size_t n) {
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    s.wanted = n;
+    update = true;
+    cv.notify_all();
+  }
+
+  void Scheduler::set_priority(Session& s, Priority p) {
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    s.priority = p;
+    update = true;
+    cv.notify_all();
+  }
+
+
+  // Scheduler::finished() is called by the main thread of a session after its
+  // "bestmove", and gives back its threads.
+
+  void Scheduler::finished(Session& s) {
+
+    std::lock_guard<std::mutex> lk(mutex);
+
+    auto it = std::find(active.begin(), active.end(), &s);
+
+    if (it == active.end()) // Closed
+        return;
+
+    s.state = Session::IDLE;
+
+    if (!s.waiting)
+        active.erase(it);
+
+    update = true;
+    cv.notify_all();
+  }
+
+
+  // Scheduler::close() forgets a session before it is destroyed, and stops its
+  // search.
+
+  void Scheduler::close(Session& s) {
+
+    std::unique_lock<std::mutex> lk(mutex);
+    cv.wait(lk, [&]{ return starting != &s; });
+
+    active.erase(std::remove(active.begin(), active.end(), &s), active.end());
+    resident.erase(std::remove(resident.begin(), resident.end(), &s), resident.end());
+    s.threads.stop = true;
+    s.threads.resume();
+
+    update = true;
+    cv.notify_all();
+  }
+
+
+  // Scheduler::busy() tells whether a session is searching or about to
+
+  bool Scheduler::busy(Session& s) {
+
+    std::lock_guard<std::mutex> lk(mutex);
+    return s.state != Session::IDLE || s.waiting || starting == &s;
+  }
+
+
+  // Scheduler::info() lists the sessions, and the time their searches waited
+  // for threads by priority.
+
+  string Scheduler::info() {
+
+    std::lock_guard<std::mutex> lk(mutex);
+    std::stringstream ss;
+    const char* states[] = { "idle", "running", "paused" };
+
+    ss << "sessions:";
+
+    for (auto& s : Sessions)
+        ss << ' ' << s.first << " (" << PriorityNames[s.second->priority]
+           << ", " << (s.second->waiting ? "waiting" : states[s.second->state])
+           << ", " << s.second->granted << '/' << s.second->wanted << " threads)";
+
+    for (int p = GAME; p >= ANALYSIS; --p)
+        ss << "\nqueue " << PriorityNames[p] << ": " << stats[p].searches << " searches, "
+           << "wait mean " << stats[p].waitSum / std::max(stats[p].searches, uint64_t(1)) / 1000
+           << " ms max " << stats[p].waitMax / 1000 << " ms, "
+           << "preempted " << stats[p].preempted;
+
+    return ss.str();
+  }
+
+
+  // session() is called when engine receives the "session" command. It runs a
+  // command of a game in the session with the given id, which is opened with
+  // one thread on first use, so that one process may play many games at once.
+  // The output of a session is tagged with its id. Sessions take the commands
+  // of a game, the other commands being for the whole process. Their searches
+  // go through the scheduler, which also bounds the memory of the sessions, see
+  // Scheduler::keep_resident().
+  //
+  // session -> lists the open sessions and the waits of their searches
+  // session 7 position startpos moves e2e4 -> opens session 7 if needed
+  // session 7 go wtime 60000 btime 60000 -> prints "session 7 bestmove ..."
+  // session 7 threads 4 -> session 7 searches with up to four threads
+  // session 7 priority analysis -> session 7 yields to hints and games
+  // session 7 quit -> stops the search of session 7 and closes it
+
+  void session(istringstream& is, int64_t received) {
+
+    string id, token, cmd;
+
+    if (!SessionScheduler)
+        SessionScheduler.reset(new Scheduler);
+
+    if (!(is >> id))
+    {
+        sync_cout << SessionScheduler->info() << sync_endl;
+        return;
+    }
+
+    getline(is >> ws, cmd);
+    istringstream ss(cmd);
+    ss >> token;
+
+    auto it = Sessions.find(id);
+
+    if (token == "quit")
+    {
+        if (it != Sessions.end())
+        {
+            SessionScheduler->close(*it->second);
+            Sessions.erase(it);
+        }
+        return;
+    }
+
+    if (it == Sessions.end())
+    {
+        std::unique_ptr<Session> s(new Session);
+        Session* sp = s.get();
+        s->threads.tag = "session " + id + " ";
+        s->threads.searchFinished = [sp]() { SessionScheduler->finished(*sp); };
+        s->threads.set(1);
+        s->threads.clear();
+        s->threads.release();
+        s->states = StateListPtr(new std::deque<StateInfo>(1));
+        s->pos.set(StartFEN, &s->states->back(), s->threads.main());
+        it = Sessions.emplace(id, std::move(s)).first;
+    }
+
+    Session& s = *it->second;
+
+    SyncTag = s.threads.tag;
+
+    if (token == "threads")
+    {
+        size_t n = 1;
+        ss >> n;
+        SessionScheduler->set_threads(s, std::max(n, size_t(1)));
+    }
+    else if (token == "priority")
+    {
+        ss >> token;
+        auto p = std::find(PriorityNames, PriorityNames + PRIORITY_NB, token);
+
+        if (p != PriorityNames + PRIORITY_NB)
+            SessionScheduler->set_priority(s, Priority(p - PriorityNames));
+        else
+            sync_cout << "No such priority: " << token << sync_endl;
+    }
+    else if (token == "go")
+        SessionScheduler->submit(s, cmd, received);
+
+    else if (token == "stop")
+        SessionScheduler->stop(s);
+
+    // The position is read when the search starts, which may be later
+    else if (   (token == "ucinewgame" || token == "position" || token == "flip")
+             && SessionScheduler->busy(s))
+        sync_cout << "Session is searching" << sync_endl;
+
+    else
+        handle_command(token, cmd, s.states, s.pos, received, s.threads);
+
+    SyncTag.clear();
+  }
+
+
+  // close_sessions() stops all the sessions and closes them, before the threads
+  // of the process exit.
+
+  void close_sessions() {
+
+    for (auto& s : Sessions)
+        SessionScheduler->close(*s.second);
+
+    Sessions.clear();
+    SessionScheduler.reset();
+  }
+
 } // namespace
 
 void print_checkers(const Position &pos) {
@@ -220,7 +1396,7 @@ void print_valid_moves(const Position &pos) {
 }
 
 void handle_command(string& token, const string& cmd, StateListPtr& states,
-                    Position& pos) {
+                    Position& pos, int64_t received, ThreadPool& threads) {
       istringstream is(cmd);
 
       token.clear(); // Avoid a stale if getline() returns empty or blank line
@@ -228,24 +1404,21 @@ void handle_command(string& token, const string& cmd, StateListPtr& states,
 
       if (    token == "quit"
           ||  token == "stop")
-          Threads.stop = true;
+          threads.stop = true;
 
       // The GUI sends 'ponderhit' to tell us the user has played the expected move.
       // So 'ponderhit' will be sent if we were told to ponder on the same move the
       // user has played. We should continue searching but switch from pondering to
       // normal search.
       else if (token == "ponderhit")
-          Threads.main()->ponder = false; // Switch to normal search
-
-      else if (token == "uci")
-          sync_cout << "id name " << engine_info(true)
-                    << "\n"       << Options
-                    << "\nuciok"  << sync_endl;
-
-      else if (token == "setoption")  setoption(is);
-      else if (token == "go")         go(pos, is, states);
-      else if (token == "position")   position(pos, is, states);
-      else if (token == "ucinewgame") Search::clear();
+      {
+          threads.main()->ponder = false; // Switch to normal search
+          threads.main()->timer.wake();
+      }
+
+      else if (token == "go")         go(pos, is, states, received, threads);
+      else if (token == "position")   position(pos, is, states, threads);
+      else if (token == "ucinewgame") clear_search(threads);
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
 
       else if (token == "valid_moves") print_valid_moves(pos);
@@ -255,10 +1428,37 @@ void handle_command(string& token, const string& cmd, StateListPtr& states,
       // Additional custom non-UCI commands, mainly for debugging.
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
-      else if (token == "bench")    bench(pos, is, states);
+      else if (token == "latency")  sync_cout << threads.time.latency_info() << sync_endl;
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     sync_cout << Eval::trace(pos) << sync_endl;
+
+      // The commands below are for the whole process, not for a session
+      else if (&threads != &Threads)
+          sync_cout << "Unknown command: " << cmd << sync_endl;
+
+      else if (token == "uci")
+          sync_cout << "id name " << engine_info(true)
+                    << "\n"       << Options
+                    << "\nuciok"  << sync_endl;
+
+      else if (token == "setoption")  setoption(is);
+      else if (token == "session")    session(is, received);
+      else if (token == "bench")    bench(pos, is, states);
+      else if (token == "perftsuite") perft_suite(pos, is, states);
+      else if (token == "selfplay")   selfplay(pos, is, states);
+      else if (token == "batch")      batch(pos, is);
+      else if (token == "microbench") microbench(is);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "numa")
+      {
+          string topology = WinProcGroup::topology();
+          sync_cout << (topology.empty() ? "1 NUMA node" : topology) << sync_endl;
+      }
+      else if (token == "hugepages")
+      {
+          string largePages = large_pages_info();
+          sync_cout << (largePages.empty() ? "Huge pages: unknown" : largePages) << sync_endl;
+      }
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
 }
@@ -284,8 +1484,10 @@ void UCI::loop(int argc, char* argv[]) {
       if (argc == 1 && !getline(cin, cmd)) // Block here waiting for input or EOF
           cmd = "quit";
 
-      handle_command(token, cmd, states, pos);
+      handle_command(token, cmd, states, pos, now_micros());
   } while (token != "quit" && argc == 1); // Command line args are one-shot
+
+  close_sessions(); // While their threads may still exit
 }
 
 
@@ -381,12 +1583,16 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
   static Position pos;
   string token;
   static StateListPtr states(new std::deque<StateInfo>(1));
+  static int64_t received = 0; // When the command was first offered
 
   if (!initialized) {
       pos.set(StartFEN, &states->back(), Threads.main());
       initialized = true;
   }
 
+  if (!received)
+      received = now_micros();
+
   for (Thread* th : Threads) {
       if (!th->threadStarted)
           return 1;
@@ -401,7 +1607,8 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
           ||  token == "stop")
           Threads.stop = true;
 
-      handle_command(token, cmd, states, pos);
+      handle_command(token, cmd, states, pos, received);
+      received = 0;
 
   return 0;
 }
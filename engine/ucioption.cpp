@@ -38,6 +38,8 @@ namespace UCI {
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_thread_setup(const Option&) { Threads.set(0); Threads.set(size_t(Options["Threads"])); Search::clear(); }
+void on_huge_pages(const Option& o) { UseHugePages = o; on_thread_setup(o); }
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -52,16 +54,23 @@ bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const
 
 void init(OptionsMap& o) {
 
+  constexpr int MaxHashMB = Is64Bit ? 33554432 : 2048;
+
   o["Debug Log File"]        << Option("", on_logger);
   o["Contempt"]              << Option(24, -100, 100);
   o["Analysis Contempt"]     << Option("Both var Off var White var Black var Both", "Both");
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["Session Threads"]       << Option(0, 0, 512);
+  o["NUMA Binding"]          << Option("Auto var Auto var On var Off", "Auto", on_thread_setup);
+  o["Huge Pages"]            << Option(true, on_huge_pages);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Perft Hash"]            << Option(16, 0, MaxHashMB);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
   o["Move Overhead"]         << Option(10, 0, 5000);
   o["Slow Mover"]            << Option(100, 10, 1000);
+  o["Effort Stop"]           << Option(false);
   o["nodestime"]             << Option(0, 0, 10000);
   o["UCI_Chess960"]          << Option(false);
   o["UCI_AnalyseMode"]       << Option(false);